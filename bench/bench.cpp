@@ -1,56 +1,510 @@
+#include "scenarios.h"
+#include "reports.h"
 #include <planet.h>
 #include <planetsuniverse.h>
+#include <version.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
 
 using namespace std;
 using namespace std::chrono;
 
-#ifdef EMSCRIPTEN
-int bench() {
+/* Everything that can be set from the command line. */
+struct Options {
+    vector<const Scenario*> scenarios;
+    vector<string> reports;
+
+    /* 0 uses each scenario's own default. */
+    size_t planets = 0;
+    int frames = 20;
+    int repetitions = 10;
+    /* Repetitions run first and thrown away, so the allocator and thread pool are warmed up. */
+    int warmup = 2;
+    unsigned int seed = 0;
+    string file;
+
+    int stepsPerFrame = 20;
+    PlanetsUniverse::ForceBackend forceBackend = PlanetsUniverse::DirectSum;
+    PlanetsUniverse::Integrator integrator = PlanetsUniverse::SemiImplicitEuler;
+    GravityKernel::InstructionSet instructionSet = GravityKernel::detect();
+    unsigned int threads = 1;
+    int timestepLevels = 0;
+
+    /* Which CPUs to run on, empty doesn't restrict anything. */
+    vector<int> cpus;
+
+    enum Format { Table, CSV, JSON } format = Table;
+    string output;
+};
+
+/* How one scenario went, all times in milliseconds per frame. */
+struct Result {
+    const Scenario* scenario;
+    size_t planets;
+    size_t remaining;
+
+    double mean, median, p95, p99, minimum, maximum;
+    PlanetsUniverse::PhaseTimes phases;
+    double forceEvaluations;
+};
+
+static void usage(ostream& out) {
+    out << "Usage: Planets3D_benchmark [options]\n"
+           "\n"
+           "  --scenario NAME      Run a scenario, can be given more than once. (Default: every scenario that doesn't need a file.)\n"
+           "  --report NAME        Run one of the comparison reports instead: integrators, timesteps, forces, determinism or all.\n"
+           "  --planets N          Use N planets instead of the scenario's default.\n"
+           "  --frames N           Frames to time in each repetition. (Default: 20)\n"
+           "  --repetitions N      Repetitions to time. (Default: 10)\n"
+           "  --warmup N           Repetitions to run and throw away first. (Default: 2)\n"
+           "  --seed N             Random seed for generating planets. (Default: 0)\n"
+           "  --load FILE          The universe for the system scenario.\n"
+           "\n"
+           "  --steps N            Steps per frame. (Default: 20)\n"
+           "  --gravity NAME       direct, barnes-hut or multipole. (Default: direct)\n"
+           "  --integrator NAME    euler, leapfrog or yoshida. (Default: euler)\n"
+           "  --instructions NAME  scalar, sse, avx2 or avx512. (Default: the best this CPU has)\n"
+           "  --threads N          Threads for calculating gravity, 0 for one per core. (Default: 1)\n"
+           "  --levels N           Block timestep levels from 0 to " << PlanetsUniverse::maxTimestepLevels << ", 0 for none. (Default: 0)\n"
+           "  --cpus LIST          Only run on these CPUs, like 0,2-3. Linux and Windows only.\n"
+           "\n"
+           "  --format NAME        table, csv or json. (Default: table)\n"
+           "  --output FILE        Write the results to a file instead of the console.\n"
+           "                       Both only apply to scenarios, reports are always tables on the console.\n"
+           "\n"
+           "Scenarios:\n";
+
+    for (const Scenario& scenario : scenarios())
+        out << "  " << setw(21) << left << scenario.name << scenario.description << "\n";
+}
+
+/* The whole value has to be a whole number from minimum to maximum, stoi() and friends would stop at anything after one
+ * and stoul() takes negative numbers as huge ones. */
+static long long parseInteger(const string& option, const string& value, long long minimum, long long maximum) {
+    size_t end = 0;
+    long long number = 0;
+
+    try {
+        number = stoll(value, &end);
+    } catch (const std::exception&) {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size())
+        throw runtime_error(option + " needs a whole number, not \"" + value + "\"!");
+    if (number < minimum || number > maximum)
+        throw runtime_error(option + " has to be from " + to_string(minimum) + " to " + to_string(maximum) + "!");
+
+    return number;
+}
+
+/* How many CPUs pinCPUs() can pick from. */
+#if defined(__linux__)
+static const int cpuLimit = CPU_SETSIZE;
+#elif defined(_WIN32)
+static const int cpuLimit = int(sizeof(DWORD_PTR) * 8);
 #else
-int main() {
+static const int cpuLimit = 1024;
 #endif
-    PlanetsUniverse universe;
 
-    /* Use a constant seed for consistency. */
-    universe.randSeed(0);
+/* Turn a list like 0,2-3 into every CPU in it. */
+static vector<int> parseCPUs(const string& list) {
+    vector<int> cpus;
+    stringstream stream(list);
+    string range;
+
+    while (getline(stream, range, ',')) {
+        size_t dash = range.find('-');
+        int first = int(parseInteger("--cpus", range.substr(0, dash), 0, cpuLimit - 1));
+        int last = dash == string::npos ? first : int(parseInteger("--cpus", range.substr(dash + 1), 0, cpuLimit - 1));
+
+        if (last < first)
+            throw runtime_error("--cpus has a range going backwards, \"" + range + "\"!");
+
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+/* Restrict the whole process to some CPUs. Any threads started afterwards stay on them too. */
+static void pinCPUs(const vector<int>& cpus) {
+    if (cpus.empty())
+        return;
+
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        throw runtime_error("Unable to run on the requested CPUs!");
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus)
+        mask |= DWORD_PTR(1) << cpu;
+
+    if (!SetProcessAffinityMask(GetCurrentProcess(), mask))
+        throw runtime_error("Unable to run on the requested CPUs!");
+#else
+    cerr << "Picking CPUs isn't supported on this platform, running anywhere." << endl;
+#endif
+}
+
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const string option = argv[i];
+
+        if (option == "--help" || option == "-h") {
+            usage(cout);
+            exit(0);
+        }
+
+        if (i + 1 >= argc)
+            throw runtime_error("Missing value for " + option + "!");
+
+        const string value = argv[++i];
+
+        if (option == "--scenario") {
+            const Scenario* scenario = findScenario(value);
+            if (scenario == nullptr)
+                throw runtime_error("Unknown scenario \"" + value + "\"!");
+            options.scenarios.push_back(scenario);
+        } else if (option == "--report") {
+            if (value == "all")
+                options.reports.insert(options.reports.end(), { "integrators", "timesteps", "forces", "determinism" });
+            else if (value == "integrators" || value == "timesteps" || value == "forces" || value == "determinism")
+                options.reports.push_back(value);
+            else
+                throw runtime_error("Unknown report \"" + value + "\"!");
+        } else if (option == "--planets") {
+            options.planets = size_t(parseInteger(option, value, 0, SlotMap::maxSize));
+        } else if (option == "--frames") {
+            options.frames = int(parseInteger(option, value, 1, numeric_limits<int>::max()));
+        } else if (option == "--repetitions") {
+            options.repetitions = int(parseInteger(option, value, 1, numeric_limits<int>::max()));
+        } else if (option == "--warmup") {
+            options.warmup = int(parseInteger(option, value, 0, numeric_limits<int>::max()));
+        } else if (option == "--seed") {
+            options.seed = unsigned(parseInteger(option, value, 0, numeric_limits<unsigned int>::max()));
+        } else if (option == "--load") {
+            options.file = value;
+        } else if (option == "--steps") {
+            options.stepsPerFrame = int(parseInteger(option, value, 1, numeric_limits<int>::max()));
+        } else if (option == "--gravity") {
+            if (value == "direct")
+                options.forceBackend = PlanetsUniverse::DirectSum;
+            else if (value == "barnes-hut")
+                options.forceBackend = PlanetsUniverse::BarnesHut;
+            else if (value == "multipole")
+                options.forceBackend = PlanetsUniverse::FastMultipole;
+            else
+                throw runtime_error("Unknown gravity method \"" + value + "\"!");
+        } else if (option == "--integrator") {
+            if (value == "euler")
+                options.integrator = PlanetsUniverse::SemiImplicitEuler;
+            else if (value == "leapfrog")
+                options.integrator = PlanetsUniverse::Leapfrog;
+            else if (value == "yoshida")
+                options.integrator = PlanetsUniverse::Yoshida4;
+            else
+                throw runtime_error("Unknown integrator \"" + value + "\"!");
+        } else if (option == "--instructions") {
+            if (value == "scalar")
+                options.instructionSet = GravityKernel::Scalar;
+            else if (value == "sse")
+                options.instructionSet = GravityKernel::SSE;
+            else if (value == "avx2")
+                options.instructionSet = GravityKernel::AVX2;
+            else if (value == "avx512")
+                options.instructionSet = GravityKernel::AVX512;
+            else
+                throw runtime_error("Unknown instruction set \"" + value + "\"!");
+        } else if (option == "--threads") {
+            options.threads = unsigned(parseInteger(option, value, 0, 1024));
+        } else if (option == "--levels") {
+            options.timestepLevels = int(parseInteger(option, value, 0, PlanetsUniverse::maxTimestepLevels));
+        } else if (option == "--cpus") {
+            options.cpus = parseCPUs(value);
+        } else if (option == "--format") {
+            if (value == "table")
+                options.format = Options::Table;
+            else if (value == "csv")
+                options.format = Options::CSV;
+            else if (value == "json")
+                options.format = Options::JSON;
+            else
+                throw runtime_error("Unknown format \"" + value + "\"!");
+        } else if (option == "--output") {
+            options.output = value;
+        } else {
+            throw runtime_error("Unknown option \"" + option + "\", use --help to see them all.");
+        }
+    }
+
+    /* Run everything that can run on its own if nothing was picked. */
+    if (options.scenarios.empty() && options.reports.empty())
+        for (const Scenario& scenario : scenarios())
+            if (scenario.defaultPlanets > 0)
+                options.scenarios.push_back(&scenario);
+
+    return options;
+}
+
+/* The smallest time that at least this fraction of the samples are at or below. The samples have to be sorted. */
+static double percentile(const vector<double>& sorted, double fraction) {
+    size_t rank = size_t(std::ceil(fraction * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+static Result runScenario(const Options& options, const Scenario& scenario) {
+    Result result = {};
+    result.scenario = &scenario;
+
+    vector<double> frameTimes;
+    PlanetsUniverse::PhaseTimes phases = {};
+    uint64_t forceEvaluations = 0;
+
+    for (int repetition = 0; repetition < options.warmup + options.repetitions; ++repetition) {
+        const bool measured = repetition >= options.warmup;
+
+        /* Start over every time, so merging in one repetition doesn't make the next one easier. */
+        PlanetsUniverse universe;
+        universe.randSeed(options.seed);
+
+        universe.stepsPerFrame = options.stepsPerFrame;
+        universe.forceBackend = options.forceBackend;
+        universe.integrator = options.integrator;
+        universe.instructionSet = options.instructionSet;
+        universe.threadCount = options.threads;
+        universe.timestepLevels = options.timestepLevels;
+
+        scenario.setup(universe, options.planets > 0 ? options.planets : scenario.defaultPlanets, options.file);
+        result.planets = universe.size();
 
-    /* Start with a thousand steps. */
-    universe.stepsPerFrame = 2000;
+        for (int frame = 0; frame < options.frames; ++frame) {
+            high_resolution_clock::time_point start = high_resolution_clock::now();
 
-    size_t sizes[] = { 20, 100, 200, 500, 800 };
+            universe.advance(scenario.frameTime);
 
-    /* Col:  |- 6-||-- 8--||---   16   ---||---   16   ---| doesn't matter,  Align left. */
-    cout << "steps planets total time      average step    remaining planets" << left << endl;
+            high_resolution_clock::time_point end = high_resolution_clock::now();
 
-    for (size_t size : sizes) {
-        universe.generateRandom(size, 1000.0f, 1.0f, 1000.0f);
+            if (measured)
+                frameTimes.push_back(duration_cast<duration<double, std::milli>>(end - start).count());
+        }
 
-        cout << setw(6) << universe.stepsPerFrame
-             << setw(8) << size;
+        if (measured) {
+            phases.gravity += universe.phaseTimes.gravity;
+            phases.integration += universe.phaseTimes.integration;
+            phases.merging += universe.phaseTimes.merging;
+            phases.paths += universe.phaseTimes.paths;
+            forceEvaluations += universe.forceEvaluations;
+        }
 
-        high_resolution_clock::time_point start = high_resolution_clock::now();
+        result.remaining = universe.size();
+    }
+
+    sort(frameTimes.begin(), frameTimes.end());
+
+    double total = 0.0;
+    for (double time : frameTimes)
+        total += time;
 
-        universe.advance(10.0f);
+    const double frames = double(frameTimes.size());
 
-        high_resolution_clock::time_point end = high_resolution_clock::now();
+    result.mean = total / frames;
+    result.median = percentile(frameTimes, 0.5);
+    result.p95 = percentile(frameTimes, 0.95);
+    result.p99 = percentile(frameTimes, 0.99);
+    result.minimum = frameTimes.front();
+    result.maximum = frameTimes.back();
 
-        double delay = duration_cast<duration<double, std::milli>>(end - start).count();
+    /* The phases are added up in seconds. */
+    result.phases.gravity = phases.gravity * 1000.0 / frames;
+    result.phases.integration = phases.integration * 1000.0 / frames;
+    result.phases.merging = phases.merging * 1000.0 / frames;
+    result.phases.paths = phases.paths * 1000.0 / frames;
+    result.forceEvaluations = double(forceEvaluations) / frames;
 
-        cout << setw(16) << to_string(delay) + "ms"
-             << setw(16) << to_string(delay / double(universe.stepsPerFrame)) + "ms"
-             << universe.size() << endl;
+    return result;
+}
+
+static void writeTable(ostream& out, const Result& result, bool header) {
+    if (header)
+        /* Col: |--   10   --||-- 8--||-- 8--||---  10  ---||---  10  ---||---  10  ---||---  10  ---||---  10  ---||---  10  ---||---  10  ---| */
+        out << "scenario  planets left    median    p95       p99       gravity   integrate merge     paths     evaluations" << left << endl;
 
-        fflush(stdout);
+    auto ms = [](double time) { return to_string(time).substr(0, 7); };
 
-        /* Clear the thing for the next one. */
-        universe.deleteAll();
+    out << setw(10) << result.scenario->name
+        << setw(8) << result.planets
+        << setw(8) << result.remaining
+        << setw(10) << ms(result.median)
+        << setw(10) << ms(result.p95)
+        << setw(10) << ms(result.p99)
+        << setw(10) << ms(result.phases.gravity)
+        << setw(10) << ms(result.phases.integration)
+        << setw(10) << ms(result.phases.merging)
+        << setw(10) << ms(result.phases.paths)
+        << size_t(result.forceEvaluations) << endl;
+}
 
-        /* Reduce the number of steps as the amount of planets increases. */
-        universe.stepsPerFrame -= 250;
+static void writeCSV(ostream& out, const Result& result, bool header) {
+    if (header)
+        out << "scenario,planets,remaining,mean_ms,median_ms,p95_ms,p99_ms,min_ms,max_ms,"
+               "gravity_ms,integration_ms,merging_ms,paths_ms,force_evaluations" << endl;
+
+    out << result.scenario->name << ',' << result.planets << ',' << result.remaining << ','
+        << result.mean << ',' << result.median << ',' << result.p95 << ',' << result.p99 << ','
+        << result.minimum << ',' << result.maximum << ','
+        << result.phases.gravity << ',' << result.phases.integration << ',' << result.phases.merging << ',' << result.phases.paths << ','
+        << result.forceEvaluations << endl;
+}
+
+/* Nothing written here needs escaping except file names, and those only need quotes and backslashes escaped. */
+static string quote(const string& text) {
+    string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+/* The same names the options take. */
+static const char* backendNames[] = { "direct", "barnes-hut", "multipole" };
+static const char* integratorNames[] = { "euler", "leapfrog", "yoshida" };
+
+static void writeJSON(ostream& out, const Options& options, const vector<Result>& results) {
+    out << "{\n"
+        << "  \"revision\": " << quote(version::git_revision) << ",\n"
+        << "  \"build\": " << quote(version::build_type) << ",\n"
+        << "  \"compiler\": " << quote(version::compiler) << ",\n"
+        << "  \"settings\": {\n"
+        << "    \"frames\": " << options.frames << ",\n"
+        << "    \"repetitions\": " << options.repetitions << ",\n"
+        << "    \"warmup\": " << options.warmup << ",\n"
+        << "    \"seed\": " << options.seed << ",\n"
+        << "    \"steps_per_frame\": " << options.stepsPerFrame << ",\n"
+        << "    \"gravity\": " << quote(backendNames[options.forceBackend]) << ",\n"
+        << "    \"integrator\": " << quote(integratorNames[options.integrator]) << ",\n"
+        << "    \"instruction_set\": " << quote(GravityKernel::name(std::min(options.instructionSet, GravityKernel::detect()))) << ",\n"
+        << "    \"threads\": " << options.threads << ",\n"
+        << "    \"timestep_levels\": " << options.timestepLevels << ",\n"
+        << "    \"file\": " << quote(options.file) << "\n"
+        << "  },\n"
+        << "  \"results\": [";
+
+    for (size_t r = 0; r < results.size(); ++r) {
+        const Result& result = results[r];
+
+        out << (r > 0 ? "," : "") << "\n    {\n"
+            << "      \"scenario\": " << quote(result.scenario->name) << ",\n"
+            << "      \"planets\": " << result.planets << ",\n"
+            << "      \"remaining\": " << result.remaining << ",\n"
+            << "      \"mean_ms\": " << result.mean << ",\n"
+            << "      \"median_ms\": " << result.median << ",\n"
+            << "      \"p95_ms\": " << result.p95 << ",\n"
+            << "      \"p99_ms\": " << result.p99 << ",\n"
+            << "      \"min_ms\": " << result.minimum << ",\n"
+            << "      \"max_ms\": " << result.maximum << ",\n"
+            << "      \"phases_ms\": { \"gravity\": " << result.phases.gravity
+            << ", \"integration\": " << result.phases.integration
+            << ", \"merging\": " << result.phases.merging
+            << ", \"paths\": " << result.phases.paths << " },\n"
+            << "      \"force_evaluations\": " << result.forceEvaluations << "\n"
+            << "    }";
+    }
+
+    out << "\n  ]\n}" << endl;
+}
+
+static int run(const Options& options) {
+    pinCPUs(options.cpus);
+
+    ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file)
+            throw runtime_error("Unable to write to \"" + options.output + "\"!");
+    }
+    ostream& out = options.output.empty() ? cout : file;
+
+    vector<Result> results;
+
+    for (const Scenario* scenario : options.scenarios) {
+        results.push_back(runScenario(options, *scenario));
+
+        /* Tables and CSV can be written as they go, so a long run shows progress. */
+        if (options.format == Options::Table)
+            writeTable(out, results.back(), results.size() == 1);
+        else if (options.format == Options::CSV)
+            writeCSV(out, results.back(), results.size() == 1);
+
+        out.flush();
+    }
+
+    if (options.format == Options::JSON)
+        writeJSON(out, options, results);
+
+    for (const string& report : options.reports) {
+        if (report == "integrators")
+            integratorReport();
+        else if (report == "timesteps")
+            timestepReport();
+        else if (report == "forces")
+            forceReport();
+        else if (report == "determinism")
+            determinismReport();
     }
 
     return 0;
 }
+
+#ifdef EMSCRIPTEN
+int bench() {
+    /* There's no command line, so just run the defaults. */
+    char name[] = "bench";
+    char* argv[] = { name };
+    return run(parseOptions(1, argv));
+}
+#else
+int main(int argc, char* argv[]) {
+    Options options;
+
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& error) {
+        cerr << error.what() << "\n\n";
+        usage(cerr);
+        return 1;
+    }
+
+    try {
+        return run(options);
+    } catch (const std::exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+}
+#endif
@@ -0,0 +1,302 @@
+#include "reports.h"
+#include <planet.h>
+#include <planetsuniverse.h>
+#include <multipoletree.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+#include <glm/gtx/rotate_vector.hpp>
+
+using namespace std;
+using namespace std::chrono;
+
+/* Run a star with rings of planets around it with each integrator, showing how well energy and momentum are kept. */
+void integratorReport() {
+    const char* names[] = { "Semi-implicit Euler", "Leapfrog", "Yoshida 4" };
+    int stepCounts[] = { 1, 4, 16 };
+
+    /* Col:  |--      20      --||- 6-||--   12   --||--   12   --||--   12   --| doesn't matter,  Align left. */
+    cout << endl << "integrator          steps energy      momentum    angular     frame time" << left << endl;
+
+    for (int integrator = PlanetsUniverse::SemiImplicitEuler; integrator <= PlanetsUniverse::Yoshida4; ++integrator) {
+        for (int steps : stepCounts) {
+            PlanetsUniverse universe;
+
+            /* The orbits are spread out so nothing merges, merging would throw off the energy. */
+            key_type star = universe.addPlanet(Planet(glm::vec3(), glm::vec3(), universe.max_mass));
+            float radius = universe[star].radius();
+
+            for (int i = 0; i < 20; ++i)
+                universe.addOrbital(star, radius * (2.0f + i * 0.5f), 10.0f, glm::rotate(0.05f * i, glm::vec3(1.0f, 0.0f, 0.0f)));
+
+            universe.integrator = PlanetsUniverse::Integrator(integrator);
+            universe.stepsPerFrame = steps;
+
+            PlanetsUniverse::ConservedQuantities before = universe.conservedQuantities();
+
+            /* Momentum is usually close to 0, so compare the error to the momentum of each planet instead. */
+            double momentumScale = 0.0;
+            for (const auto& planet : universe)
+                momentumScale += planet.mass() * glm::length(planet.velocity);
+
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+
+            /* A few orbits of the inner planets. */
+            const int frames = 100;
+            for (int i = 0; i < frames; ++i)
+                universe.advance(2.0e5f);
+
+            high_resolution_clock::time_point end = high_resolution_clock::now();
+
+            PlanetsUniverse::ConservedQuantities after = universe.conservedQuantities();
+
+            double delay = duration_cast<duration<double, std::milli>>(end - start).count();
+
+            cout << setw(20) << names[integrator]
+                 << setw(6) << steps
+                 << setw(12) << std::abs((after.energy - before.energy) / before.energy)
+                 << setw(12) << glm::length(after.momentum - before.momentum) / momentumScale
+                 << setw(12) << glm::length(after.angularMomentum - before.angularMomentum) / glm::length(before.angularMomentum)
+                 << to_string(delay / frames) + "ms";
+
+            if (universe.size() != 21)
+                cout << " (planets merged, energy isn't comparable)";
+
+            cout << endl;
+        }
+    }
+}
+
+/* Planets spread out from just above a star to 75 times its radius, so the inner ones go around hundreds of times faster than the outer ones.
+ * Compare the same scene with every planet on the same step against block timesteps, where only the inner planets take short steps. */
+void timestepReport() {
+    struct Setup {
+        const char* name;
+        PlanetsUniverse::Integrator integrator;
+        int steps;
+        int levels;
+    };
+
+    Setup setups[] = {
+        { "Semi-implicit Euler", PlanetsUniverse::SemiImplicitEuler, 64, 0 },
+        { "Semi-implicit Euler", PlanetsUniverse::SemiImplicitEuler, 256, 0 },
+        { "Leapfrog", PlanetsUniverse::Leapfrog, 16, 0 },
+        { "Leapfrog", PlanetsUniverse::Leapfrog, 64, 0 },
+        { "Block timesteps", PlanetsUniverse::Leapfrog, 4, 4 },
+        { "Block timesteps", PlanetsUniverse::Leapfrog, 1, 8 }
+    };
+
+    /* Col:  |--      20      --||- 6-||- 6-||--   12   --||--   12   --||--   12   --| doesn't matter,  Align left. */
+    cout << endl << "timesteps           steps levels evaluations energy      frame time  planets per level" << left << endl;
+
+    for (const Setup& setup : setups) {
+        PlanetsUniverse universe;
+
+        key_type star = universe.addPlanet(Planet(glm::vec3(), glm::vec3(), universe.max_mass));
+        float radius = universe[star].radius();
+
+        for (int i = 0; i < 200; ++i)
+            universe.addOrbital(star, radius * 2.0f * std::pow(1.2f, float(i % 20)), 10.0f,
+                                glm::rotate(0.05f * i, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::rotate(0.7f * i, glm::vec3(0.0f, 0.0f, 1.0f)));
+
+        universe.integrator = setup.integrator;
+        universe.stepsPerFrame = setup.steps;
+        universe.timestepLevels = setup.levels;
+
+        PlanetsUniverse::ConservedQuantities before = universe.conservedQuantities();
+
+        high_resolution_clock::time_point start = high_resolution_clock::now();
+
+        const int frames = 50;
+        for (int i = 0; i < frames; ++i)
+            universe.advance(2.0e5f);
+
+        high_resolution_clock::time_point end = high_resolution_clock::now();
+
+        PlanetsUniverse::ConservedQuantities after = universe.conservedQuantities();
+
+        double delay = duration_cast<duration<double, std::milli>>(end - start).count();
+
+        cout << setw(20) << setup.name
+             << setw(6) << setup.steps
+             << setw(7) << setup.levels
+             << setw(12) << universe.forceEvaluations / frames
+             << setw(12) << std::abs((after.energy - before.energy) / before.energy)
+             << setw(12) << to_string(delay / frames) + "ms";
+
+        for (size_t count : universe.timestepOccupancy())
+            cout << count << ' ';
+
+        if (universe.size() != 201)
+            cout << "(planets merged, energy isn't comparable)";
+
+        cout << endl;
+    }
+}
+
+/* Compare each way of calculating gravity on one big universe, against the exact result for a sample of the planets.
+ * Direct sum on everything would take too long, so its time is worked out from how long the sample took. */
+void forceReport() {
+    size_t sizes[] = { 10000, 100000 };
+    const size_t samples = 1000;
+
+    /* Col:  |--      20      --||--   12   --||---   16   ---||--   12   --| doesn't matter,  Align left. */
+    cout << endl << "force               planets     time            mean error  max error" << left << endl;
+
+    for (size_t count : sizes) {
+        /* Half the planets spread out and half in a dense clump, so the tree isn't just evenly filled. */
+        std::default_random_engine generator(0);
+        std::uniform_real_distribution<float> position(-1.0e4f, 1.0e4f);
+        std::uniform_real_distribution<float> mass(1.0f, 1000.0f);
+
+        std::vector<glm::vec3> positions(count);
+        std::vector<float> masses(count), radii(count);
+
+        for (size_t i = 0; i < count; ++i) {
+            positions[i] = glm::vec3(position(generator), position(generator), position(generator)) * (i % 2 ? 0.05f : 1.0f);
+            masses[i] = mass(generator);
+            radii[i] = Planet::radiusFromMass(masses[i]);
+        }
+
+        std::vector<uint32_t> sample(samples);
+        for (size_t s = 0; s < samples; ++s)
+            sample[s] = uint32_t(s * (count / samples));
+
+        /* The exact answer for the sample. */
+        GravityKernel kernel;
+        kernel.load(positions.data(), masses.data(), radii.data(), count);
+
+        std::vector<glm::vec3> exact(samples);
+
+        high_resolution_clock::time_point start = high_resolution_clock::now();
+        kernel.accumulate(GravityKernel::detect(), sample.data(), samples, exact.data());
+        high_resolution_clock::time_point end = high_resolution_clock::now();
+
+        double delay = duration_cast<duration<double, std::milli>>(end - start).count() * double(count) / samples;
+
+        cout << setw(20) << "Direct sum"
+             << setw(12) << count
+             << setw(16) << to_string(delay) + "ms"
+             << "(estimated)" << endl;
+
+        std::vector<glm::vec3> accelerations(count);
+
+        auto report = [&](const string& name) {
+            double total = 0.0, worst = 0.0;
+
+            for (size_t s = 0; s < samples; ++s) {
+                double error = glm::length(accelerations[sample[s]] - exact[s]) / glm::length(exact[s]);
+                total += error;
+                worst = std::max(worst, error);
+            }
+
+            double delay = duration_cast<duration<double, std::milli>>(end - start).count();
+
+            cout << setw(20) << name
+                 << setw(12) << count
+                 << setw(16) << to_string(delay) + "ms"
+                 << setw(12) << total / samples
+                 << worst << endl;
+        };
+
+        Octree octree;
+
+        for (float theta : { 0.5f, 0.8f }) {
+            start = high_resolution_clock::now();
+
+            octree.bodies.resize(count);
+            for (uint32_t i = 0; i < count; ++i)
+                octree.bodies[i] = Octree::Body{ positions[i], masses[i], radii[i], i };
+
+            octree.build();
+
+            for (uint32_t b = 0; b < count; ++b)
+                accelerations[octree.bodies[b].index] = octree.acceleration(b, theta);
+
+            end = high_resolution_clock::now();
+
+            report("Barnes-Hut " + to_string(theta).substr(0, 3));
+        }
+
+        ThreadPool pool;
+        MultipoleTree multipoles;
+
+        for (int order : { 2, 4, 6 }) {
+            start = high_resolution_clock::now();
+            multipoles.solve(positions.data(), masses.data(), radii.data(), count, order, 0.6f, GravityKernel::detect(), pool, accelerations.data());
+            end = high_resolution_clock::now();
+
+            report("Multipole order " + to_string(order));
+        }
+
+        fflush(stdout);
+    }
+}
+
+/* Generate the same universe from a seed and run it with 1, 2 and every core, comparing the state hashes at the end.
+ * Merges happen along the way, so their order gets checked too. */
+void determinismReport() {
+    struct Setup {
+        const char* name;
+        PlanetsUniverse::ForceBackend backend;
+        GravityKernel::InstructionSet instructionSet;
+        int levels;
+        bool deterministic;
+    };
+
+    Setup setups[] = {
+        { "Direct scalar", PlanetsUniverse::DirectSum, GravityKernel::Scalar, 0, false },
+        { "Direct scalar", PlanetsUniverse::DirectSum, GravityKernel::Scalar, 0, true },
+        { "Direct vector", PlanetsUniverse::DirectSum, GravityKernel::detect(), 0, true },
+        { "Block timesteps", PlanetsUniverse::DirectSum, GravityKernel::Scalar, 4, true },
+        { "Barnes-Hut", PlanetsUniverse::BarnesHut, GravityKernel::detect(), 0, true },
+        { "Multipole", PlanetsUniverse::FastMultipole, GravityKernel::detect(), 0, true }
+    };
+
+    unsigned int threadCounts[] = { 1, 2, 0 };
+
+    /* Col:  |--      20      --||- 6-||--      16      --||--      16      --||--      16      --| doesn't matter,  Align left. */
+    cout << endl << "determinism         flag  1 thread          2 threads         every core        planets" << left << endl;
+
+    for (const Setup& setup : setups) {
+        uint64_t hashes[3];
+        size_t planets = 0;
+
+        for (int t = 0; t < 3; ++t) {
+            PlanetsUniverse universe;
+            universe.randSeed(1);
+
+            key_type star = universe.addPlanet(Planet(glm::vec3(), glm::vec3(), universe.max_mass));
+            universe.generateRandomOrbital(2000, star);
+
+            universe.forceBackend = setup.backend;
+            universe.instructionSet = setup.instructionSet;
+            universe.integrator = PlanetsUniverse::Leapfrog;
+            universe.timestepLevels = setup.levels;
+            universe.deterministic = setup.deterministic;
+            universe.threadCount = threadCounts[t];
+
+            for (int i = 0; i < 20; ++i)
+                universe.advance(2.0e5f);
+
+            hashes[t] = universe.stateHash();
+            planets = universe.size();
+        }
+
+        cout << setw(20) << setup.name
+             << setw(6) << (setup.deterministic ? "yes" : "no") << hex << setfill('0');
+
+        for (uint64_t hash : hashes)
+            cout << setw(16) << hash << "  ";
+
+        cout << dec << setfill(' ') << planets;
+
+        if (hashes[0] != hashes[1] || hashes[0] != hashes[2])
+            cout << " (differs)";
+
+        cout << endl;
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+/* Reports that compare the different ways of simulating, rather than timing one setup. */
+
+/* Run a star with rings of planets around it with each integrator, showing how well energy and momentum are kept. */
+void integratorReport();
+
+/* Compare fixed steps against block timesteps on planets spread out from a star. */
+void timestepReport();
+
+/* Compare the accuracy and speed of each way of calculating gravity on one big universe. */
+void forceReport();
+
+/* Run the same seeded universe with different numbers of threads, showing which setups give exactly the same results. */
+void determinismReport();
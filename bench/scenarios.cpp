@@ -0,0 +1,51 @@
+#include "scenarios.h"
+#include <stdexcept>
+
+/* Planets scattered randomly through a cube, the same as the original benchmark. */
+static void cloud(PlanetsUniverse& universe, size_t planets, const std::string&) {
+    universe.generateRandom(planets, 1000.0f, 1.0f, 1000.0f);
+}
+
+/* A heavy star with everything else orbiting it, the same as using the orbital generator in the interface. */
+static void disk(PlanetsUniverse& universe, size_t planets, const std::string&) {
+    key_type star = universe.addPlanet(Planet(glm::vec3(), glm::vec3(), universe.max_mass));
+
+    if (planets > 1)
+        universe.generateRandomOrbital(planets - 1, star);
+}
+
+/* Planets packed in so tightly and moving fast enough that they keep running into each other. */
+static void storm(PlanetsUniverse& universe, size_t planets, const std::string&) {
+    universe.generateRandom(planets, 300.0f, 2.0f, 1000.0f);
+}
+
+#ifndef EMSCRIPTEN
+/* Whatever is in a saved universe. */
+static void loaded(PlanetsUniverse& universe, size_t, const std::string& file) {
+    if (file.empty())
+        throw std::runtime_error("The system scenario needs a file to load, use --load.");
+
+    universe.load(file);
+}
+#endif
+
+const std::vector<Scenario>& scenarios() {
+    static const std::vector<Scenario> list = {
+        { "cloud", "random planets in a cube", 500, 10.0f, cloud },
+        { "disk", "planets orbiting a star", 2000, 1.0e5f, disk },
+        { "storm", "planets constantly merging", 2000, 10.0f, storm },
+#ifndef EMSCRIPTEN
+        { "system", "a universe loaded from a file", 0, 1.0f, loaded },
+#endif
+    };
+
+    return list;
+}
+
+const Scenario* findScenario(const std::string& name) {
+    for (const Scenario& scenario : scenarios())
+        if (name == scenario.name)
+            return &scenario;
+
+    return nullptr;
+}
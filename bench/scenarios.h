@@ -0,0 +1,25 @@
+#pragma once
+
+#include <planetsuniverse.h>
+#include <string>
+#include <vector>
+
+/* A universe to benchmark. It gets set up from scratch before every repetition, so each one starts out the same. */
+struct Scenario {
+    const char* name;
+    const char* description;
+
+    /* How many planets to use when the command line doesn't say. */
+    size_t defaultPlanets;
+    /* How much time each frame advances by. */
+    float frameTime;
+
+    /* Fill the empty universe with about this many planets. The file is only used by scenarios that load one. */
+    void (*setup)(PlanetsUniverse& universe, size_t planets, const std::string& file);
+};
+
+/* Every scenario, in the order they run by default. */
+const std::vector<Scenario>& scenarios();
+
+/* Find a scenario by name, or get nullptr. */
+const Scenario* findScenario(const std::string& name);
@@ -0,0 +1,307 @@
+#include <planetsuniverse.h>
+#include <recording.h>
+#include <version.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+/* advance() takes microseconds. */
+static const double microsecondsPerSecond = 1.0e6;
+
+/* Everything that can be set from the command line. */
+struct Options {
+    string input;
+    string output = "snapshot";
+    /* Save in the binary format instead of XML. */
+    bool binary = false;
+
+    /* Record every this many steps to a file that can be played back, if there is one. */
+    string record;
+    int recordEvery = 1;
+
+    /* All in simulated seconds, except the step which is in the same units as advance(). */
+    double time = 60.0;
+    double every = 0.0;
+    float step = 1000.0f;
+
+    PlanetsUniverse::ForceBackend forceBackend = PlanetsUniverse::DirectSum;
+    PlanetsUniverse::Integrator integrator = PlanetsUniverse::SemiImplicitEuler;
+    GravityKernel::InstructionSet instructionSet = GravityKernel::detect();
+    unsigned int threads = 1;
+    int timestepLevels = 0;
+    bool deterministic = false;
+    /* Negative leaves the universe's default alone. */
+    float theta = -1.0f;
+    int multipoleOrder = 0;
+
+    bool quiet = false;
+};
+
+static void usage(ostream& out) {
+    out << "Usage: Planets3D_cli [options] FILE\n"
+           "\n"
+           "Runs the universe in FILE without any graphics, saving it as it goes.\n"
+           "\n"
+           "  --time SECONDS       Simulated seconds to run for. (Default: 60)\n"
+           "  --step N             Simulated microseconds per step. (Default: 1000)\n"
+           "  --every SECONDS      Save every this many simulated seconds, 0 to only save at the end. (Default: 0)\n"
+           "  --output PREFIX      Save to PREFIX-000001.xml and so on. (Default: snapshot)\n"
+           "  --binary             Save in the binary format, to PREFIX-000001.p3d and so on.\n"
+           "  --record FILE        Also record the run to FILE, which the viewers can play back.\n"
+           "  --record-every N     Steps between recorded frames. (Default: 1)\n"
+           "  --quiet              Don't print anything unless something goes wrong.\n"
+           "\n"
+           "  --gravity NAME       direct, barnes-hut or multipole. (Default: direct)\n"
+           "  --theta N            The opening angle for barnes-hut or multipole.\n"
+           "  --order N            Terms kept by multipole, 1 to " << MultipoleTree::maxOrder << ".\n"
+           "  --integrator NAME    euler, leapfrog or yoshida. (Default: euler)\n"
+           "  --instructions NAME  scalar, sse, avx2 or avx512. (Default: the best this CPU has)\n"
+           "  --threads N          Threads for calculating gravity, 0 for one per core. (Default: 1)\n"
+           "  --levels N           Block timestep levels from 0 to " << PlanetsUniverse::maxTimestepLevels << ", 0 for none. (Default: 0)\n"
+           "  --deterministic      Give exactly the same results with any number of threads.\n"
+           "\n"
+           "Planets3D " << version::git_revision << "\n";
+}
+
+/* The whole value has to be a whole number from minimum to maximum, stoi() and friends would stop at anything after one
+ * and stoul() takes negative numbers as huge ones. */
+static long long parseInteger(const string& option, const string& value, long long minimum, long long maximum) {
+    size_t end = 0;
+    long long number = 0;
+
+    try {
+        number = stoll(value, &end);
+    } catch (const std::exception&) {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size())
+        throw runtime_error(option + " needs a whole number, not \"" + value + "\"!");
+    if (number < minimum || number > maximum)
+        throw runtime_error(option + " has to be from " + to_string(minimum) + " to " + to_string(maximum) + "!");
+
+    return number;
+}
+
+/* Same for any number, which can't be infinite or negative. */
+static double parseNumber(const string& option, const string& value) {
+    size_t end = 0;
+    double number = 0.0;
+
+    try {
+        number = stod(value, &end);
+    } catch (const std::exception&) {
+        end = 0;
+    }
+
+    if (end == 0 || end != value.size() || !std::isfinite(number))
+        throw runtime_error(option + " needs a number, not \"" + value + "\"!");
+    if (number < 0.0)
+        throw runtime_error(option + " can't be negative!");
+
+    return number;
+}
+
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const string option = argv[i];
+
+        if (option == "--help" || option == "-h") {
+            usage(cout);
+            exit(0);
+        }
+
+        if (option == "--quiet") {
+            options.quiet = true;
+            continue;
+        }
+
+        if (option == "--binary") {
+            options.binary = true;
+            continue;
+        }
+
+        if (option == "--deterministic") {
+            options.deterministic = true;
+            continue;
+        }
+
+        /* Anything that isn't an option is the file to run. */
+        if (option.compare(0, 2, "--") != 0) {
+            if (!options.input.empty())
+                throw runtime_error("Only one file can be run at a time!");
+            options.input = option;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            throw runtime_error("Missing value for " + option + "!");
+
+        const string value = argv[++i];
+
+        if (option == "--time") {
+            options.time = parseNumber(option, value);
+        } else if (option == "--step") {
+            options.step = float(parseNumber(option, value));
+            if (!(options.step > 0.0f))
+                throw runtime_error("The step has to be longer than 0!");
+        } else if (option == "--every") {
+            options.every = parseNumber(option, value);
+        } else if (option == "--output") {
+            options.output = value;
+        } else if (option == "--record") {
+            options.record = value;
+        } else if (option == "--record-every") {
+            options.recordEvery = int(parseInteger(option, value, 1, std::numeric_limits<int>::max()));
+        } else if (option == "--gravity") {
+            if (value == "direct")
+                options.forceBackend = PlanetsUniverse::DirectSum;
+            else if (value == "barnes-hut")
+                options.forceBackend = PlanetsUniverse::BarnesHut;
+            else if (value == "multipole")
+                options.forceBackend = PlanetsUniverse::FastMultipole;
+            else
+                throw runtime_error("Unknown gravity method \"" + value + "\"!");
+        } else if (option == "--theta") {
+            options.theta = float(parseNumber(option, value));
+        } else if (option == "--order") {
+            options.multipoleOrder = int(parseInteger(option, value, 1, MultipoleTree::maxOrder));
+        } else if (option == "--integrator") {
+            if (value == "euler")
+                options.integrator = PlanetsUniverse::SemiImplicitEuler;
+            else if (value == "leapfrog")
+                options.integrator = PlanetsUniverse::Leapfrog;
+            else if (value == "yoshida")
+                options.integrator = PlanetsUniverse::Yoshida4;
+            else
+                throw runtime_error("Unknown integrator \"" + value + "\"!");
+        } else if (option == "--instructions") {
+            if (value == "scalar")
+                options.instructionSet = GravityKernel::Scalar;
+            else if (value == "sse")
+                options.instructionSet = GravityKernel::SSE;
+            else if (value == "avx2")
+                options.instructionSet = GravityKernel::AVX2;
+            else if (value == "avx512")
+                options.instructionSet = GravityKernel::AVX512;
+            else
+                throw runtime_error("Unknown instruction set \"" + value + "\"!");
+        } else if (option == "--threads") {
+            options.threads = unsigned(parseInteger(option, value, 0, 1024));
+        } else if (option == "--levels") {
+            options.timestepLevels = int(parseInteger(option, value, 0, PlanetsUniverse::maxTimestepLevels));
+        } else {
+            throw runtime_error("Unknown option \"" + option + "\", use --help to see them all.");
+        }
+    }
+
+    if (options.input.empty())
+        throw runtime_error("No file to run, use --help to see how.");
+
+    return options;
+}
+
+/* Where the snapshot with this number goes. */
+static string snapshotName(const Options& options, int number) {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "-%06d", number);
+    return options.output + suffix + (options.binary ? PlanetsUniverse::binaryExtension : ".xml");
+}
+
+static int run(const Options& options) {
+    PlanetsUniverse universe;
+    const int loaded = universe.load(options.input);
+
+    universe.forceBackend = options.forceBackend;
+    universe.integrator = options.integrator;
+    universe.instructionSet = options.instructionSet;
+    universe.threadCount = options.threads;
+    universe.timestepLevels = options.timestepLevels;
+    universe.deterministic = options.deterministic;
+    if (options.theta >= 0.0f)
+        universe.barnesHutTheta = universe.multipoleTheta = options.theta;
+    if (options.multipoleOrder > 0)
+        universe.multipoleOrder = options.multipoleOrder;
+
+    /* Nothing is ever drawn, so the paths would just be wasted time. */
+    universe.pathLength = 0;
+
+    /* Each advance() is exactly one step, so the run is the same no matter how the snapshots fall. */
+    universe.fixedTimestep = true;
+    universe.fixedStep = options.step;
+
+    const uint64_t totalSteps = uint64_t(std::llround(options.time * microsecondsPerSecond / options.step));
+    /* Without --every the only snapshot is the one at the end. */
+    const uint64_t snapshotSteps = options.every > 0.0 ? max<uint64_t>(1, uint64_t(std::llround(options.every * microsecondsPerSecond / options.step))) : totalSteps;
+
+    if (!options.quiet)
+        cout << "Loaded " << loaded << " planet(s) from \"" << options.input << "\", running " << totalSteps << " step(s)." << endl;
+
+    /* The recording starts with how the universe was loaded. */
+    unique_ptr<Recorder> recorder;
+    if (!options.record.empty()) {
+        recorder.reset(new Recorder(options.record));
+        recorder->record(universe, 0.0);
+        recorder->every = options.recordEvery;
+    }
+
+    const steady_clock::time_point start = steady_clock::now();
+    int snapshots = 0;
+
+    for (uint64_t step = 1; step <= totalSteps; ++step) {
+        universe.advance(options.step);
+
+        if (recorder)
+            recorder->record(universe, double(step) * options.step / microsecondsPerSecond);
+
+        if (step % snapshotSteps == 0 || step == totalSteps) {
+            const string name = snapshotName(options, ++snapshots);
+            universe.save(name);
+
+            if (!options.quiet)
+                cout << "t=" << double(step) * options.step / microsecondsPerSecond << "s  "
+                     << universe.size() << " planet(s)  "
+                     /* Runs that should match can be compared with this instead of the files. */
+                     << "hash " << hex << setw(16) << setfill('0') << universe.stateHash() << dec << setfill(' ') << "  "
+                     << duration<double>(steady_clock::now() - start).count() << "s elapsed  "
+                     << name << endl;
+        }
+    }
+
+    if (recorder && !options.quiet)
+        cout << "Recorded " << recorder->frames() << " frame(s) to \"" << options.record << "\", " << recorder->bytes() << " bytes." << endl;
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& error) {
+        cerr << error.what() << "\n\n";
+        usage(cerr);
+        return 1;
+    }
+
+    try {
+        return run(options);
+    } catch (const std::exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+}
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <GLES2/gl2.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GLES2/gl2ext.h>
 #include <bind.h>
 
 constexpr GLuint vertex = 0;
 constexpr GLuint uv     = 1;
+/* Position and radius of each planet when drawing them instanced, see PlanetInstances. */
+constexpr GLuint instance = 2;
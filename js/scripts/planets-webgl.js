@@ -2,6 +2,12 @@ var spheres, context, grid;
 
 var colorShader, colorCameraMat, colorModelMat, colorColor;
 var textureShader, textureCameraMat, textureModelMat, planetTexture;
+var impostorShader, impostorCameraMat;
+
+/* Can every planet be drawn with one call? */
+var instancing = false;
+/* Can planets be drawn as one quad each? Writing depth from the fragment shader needs EXT_frag_depth. */
+var impostors = false;
 
 /* Convinience function to create a matrix with a position and scale value. */
 function makeMat(pos, scale) {
@@ -54,6 +60,7 @@ function initShaderProgram(vsh, fsh) {
     /* Make sure the attributes are bound to the same values used in C++. */
     GLctx.bindAttribLocation(program, 0, "vertex");
     GLctx.bindAttribLocation(program, 1, "uv");
+    GLctx.bindAttribLocation(program, 2, "instance");
 
     GLctx.attachShader(program, vertex);
     GLctx.attachShader(program, fragment);
@@ -86,6 +93,10 @@ function initGL() {
 
     GLctx.clear(GLctx.COLOR_BUFFER_BIT | GLctx.DEPTH_BUFFER_BIT);
 
+    /* Almost every browser has this, but fall back to drawing each planet on its own if not. */
+    instancing = GLctx.getExtension("ANGLE_instanced_arrays") !== null;
+    impostors = instancing && GLctx.getExtension("EXT_frag_depth") !== null;
+
     colorShader = initShaderProgram("color-vertex", "color-fragment");
 
     colorCameraMat = GLctx.getUniformLocation(colorShader, "cameraMatrix");
@@ -97,6 +108,12 @@ function initGL() {
     textureCameraMat = GLctx.getUniformLocation(textureShader, "cameraMatrix");
     textureModelMat = GLctx.getUniformLocation(textureShader, "modelMatrix");
 
+    if (impostors) {
+        impostorShader = initShaderProgram("impostor-vertex", "impostor-fragment");
+
+        impostorCameraMat = GLctx.getUniformLocation(impostorShader, "cameraMatrix");
+    }
+
     planetTexture = loadTexture("images/planet.png");
 
     spheres = new Module.Spheres();
@@ -132,10 +149,28 @@ function paint() {
 
     spheres.bindSolid()
 
-    for (var i = 0; i < universe.size(); ++i) {
-        GLctx.uniformMatrix4fv(textureModelMat, false, makeMat(universe.getPlanetPosition(i), universe.getPlanetRadius(i)));
+    if (instancing) {
+        GLctx.uniformMatrix4fv(textureModelMat, false, IDENTITY_MATRIX);
+
+        var drawImpostors = impostors && document.getElementById("drawImpostors").checked;
 
-        spheres.drawSolid()
+        spheres.drawSolidInstanced(universe, camera, drawImpostors);
+
+        if (drawImpostors) {
+            GLctx.useProgram(impostorShader);
+            GLctx.uniformMatrix4fv(impostorCameraMat, false, cameraMat);
+
+            spheres.drawImpostors(camera);
+        }
+    } else {
+        spheres.cull(universe, camera);
+
+        for (var i = 0; i < spheres.visibleSize(); ++i) {
+            var key = universe.keyAt(spheres.visibleIndex(i));
+            GLctx.uniformMatrix4fv(textureModelMat, false, makeMat(universe.getPlanetPosition(key), universe.getPlanetRadius(key)));
+
+            spheres.drawSolid()
+        }
     }
 
     GLctx.useProgram(colorShader);
@@ -1,13 +1,22 @@
 #include <spheregenerator.h>
 #include <grid.h>
 #include <camera.h>
+#include <planetinstances.h>
+#include <algorithm>
 #include "glbindings.h"
 
 class Spheres {
-    GLuint highResVBO, highResTriIBO, highResTriCount;
+    /* Every level of detail for planets, see SphereLevels. */
+    GLuint planetVBO, planetIBO;
+    uint32_t planetIndexStart[SphereLevels::levels + 1];
     GLuint lowResVBO, lowResLineIBO, lowResLineCount;
     GLuint circleVBO, circleLineIBO, circleLineCount;
 
+    GLuint instanceVBO;
+    PlanetInstances planetInstances;
+
+    GLuint impostorVBO;
+
 public:
     Spheres();
 
@@ -15,24 +24,32 @@ public:
     void bindWire();
     void bindCircle();
 
+    /* Find the planets the camera can see, drawSolidInstanced() does this itself. */
+    void cull(PlanetsUniverse& universe, Camera& camera);
+    inline size_t visibleSize() const { return planetInstances.visible.size(); }
+    inline uint32_t visibleIndex(size_t i) const { return planetInstances.visible[i]; }
+
     void drawSolid();
+    void drawSolidInstanced(PlanetsUniverse& universe, Camera& camera, bool pointsOnly);
+    void drawImpostors(Camera& camera);
     void drawWire();
     void drawCircle();
     void drawArrow(float length);
 };
 
 Spheres::Spheres() {
-    Sphere<64, 32> highResSphere;
+    SphereLevels planetSpheres;
     Sphere<32, 16> lowResSphere;
     Circle<64> circle;
+    ImpostorQuad impostor;
 
-    glGenBuffers(1, &highResVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, highResVBO);
-    glBufferData(GL_ARRAY_BUFFER, highResSphere.vertexCount * sizeof(Vertex), highResSphere.verts, GL_STATIC_DRAW);
+    glGenBuffers(1, &planetVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, planetVBO);
+    glBufferData(GL_ARRAY_BUFFER, planetSpheres.verts.size() * sizeof(Vertex), planetSpheres.verts.data(), GL_STATIC_DRAW);
 
-    glGenBuffers(1, &highResTriIBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, highResTriIBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, highResSphere.triangleCount * sizeof(uint32_t), highResSphere.triangles, GL_STATIC_DRAW);
+    glGenBuffers(1, &planetIBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, planetIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, planetSpheres.indices.size() * sizeof(uint32_t), planetSpheres.indices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &lowResVBO);
     glBindBuffer(GL_ARRAY_BUFFER, lowResVBO);
@@ -50,16 +67,25 @@ Spheres::Spheres() {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, circleLineIBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, circle.lineCount * sizeof(uint32_t), circle.lines, GL_STATIC_DRAW);
 
-    highResTriCount = highResSphere.triangleCount;
+    glGenBuffers(1, &impostorVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, impostorVBO);
+    glBufferData(GL_ARRAY_BUFFER, impostor.vertexCount * sizeof(glm::vec2), impostor.verts, GL_STATIC_DRAW);
+
+    std::copy(planetSpheres.indexStart, planetSpheres.indexStart + SphereLevels::levels + 1, planetIndexStart);
     lowResLineCount = lowResSphere.lineCount;
     circleLineCount = circle.lineCount;
 
+    glGenBuffers(1, &instanceVBO);
+
     glEnableVertexAttribArray(vertex);
+
+    /* When the instance attribute isn't an array, the model matrix places the sphere instead. */
+    glVertexAttrib4f(instance, 0.0f, 0.0f, 0.0f, 1.0f);
 }
 
 void Spheres::bindSolid() {
-    glBindBuffer(GL_ARRAY_BUFFER, highResVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, highResTriIBO);
+    glBindBuffer(GL_ARRAY_BUFFER, planetVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, planetIBO);
 
     glEnableVertexAttribArray(uv);
     glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
@@ -82,8 +108,73 @@ void Spheres::bindCircle() {
     glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
 }
 
+void Spheres::cull(PlanetsUniverse& universe, Camera& camera) {
+    planetInstances.update(universe, camera);
+}
+
+/* Always the most detailed level, so this is only for browsers without instancing. */
 void Spheres::drawSolid() {
-    glDrawElements(GL_TRIANGLES, highResTriCount, GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, planetIndexStart[1] - planetIndexStart[0], GL_UNSIGNED_INT, 0);
+}
+
+/* Needs ANGLE_instanced_arrays, the model matrix should be the identity. With pointsOnly only the planets too small
+ * for anything but a point get drawn, so drawImpostors() can do the rest. */
+void Spheres::drawSolidInstanced(PlanetsUniverse& universe, Camera& camera, bool pointsOnly) {
+    cull(universe, camera);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, planetInstances.size() * sizeof(glm::vec4), planetInstances.instances.data(), GL_STREAM_DRAW);
+
+    glEnableVertexAttribArray(instance);
+    glVertexAttribDivisorANGLE(instance, 1);
+
+    for (int level = pointsOnly ? SphereLevels::pointLevel : 0; level < PlanetInstances::levels; ++level) {
+        if (planetInstances.levelSize(level) == 0)
+            continue;
+
+        /* Start the instances at the level's first planet. */
+        glVertexAttribPointer(instance, 4, GL_FLOAT, GL_FALSE, 0, (void*)(planetInstances.levelStart[level] * sizeof(glm::vec4)));
+
+        glDrawElementsInstancedANGLE(level == SphereLevels::pointLevel ? GL_POINTS : GL_TRIANGLES,
+                                     planetIndexStart[level + 1] - planetIndexStart[level], GL_UNSIGNED_INT,
+                                     (void*)(planetIndexStart[level] * sizeof(uint32_t)), GLsizei(planetInstances.levelSize(level)));
+    }
+
+    glVertexAttribDivisorANGLE(instance, 0);
+    glDisableVertexAttribArray(instance);
+
+    /* Leave the spheres bound, like bindSolid() does. */
+    glBindBuffer(GL_ARRAY_BUFFER, planetVBO);
+}
+
+/* Draw every planet that isn't a point as a quad, using the instances from the last drawSolidInstanced().
+ * Needs the impostor shader in use, and binds its own buffers. */
+void Spheres::drawImpostors(Camera& camera) {
+    const GLsizei count = GLsizei(planetInstances.levelStart[SphereLevels::pointLevel]);
+    if (count == 0)
+        return;
+
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+    const glm::vec3 eye = camera.getEye();
+    const glm::vec3 up = camera.getUp();
+    glUniform3fv(glGetUniformLocation(program, "eye"), 1, &eye[0]);
+    glUniform3fv(glGetUniformLocation(program, "up"), 1, &up[0]);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glEnableVertexAttribArray(instance);
+    glVertexAttribDivisorANGLE(instance, 1);
+    glVertexAttribPointer(instance, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, impostorVBO);
+    glDisableVertexAttribArray(uv);
+    glVertexAttribPointer(vertex, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glDrawArraysInstancedANGLE(GL_TRIANGLE_STRIP, 0, ImpostorQuad::vertexCount, count);
+
+    glVertexAttribDivisorANGLE(instance, 0);
+    glDisableVertexAttribArray(instance);
 }
 
 void Spheres::drawWire() {
@@ -143,7 +234,12 @@ EMSCRIPTEN_BINDINGS(sphere) {
             .function("bindSolid",  &Spheres::bindSolid)
             .function("bindWire",   &Spheres::bindWire)
             .function("bindCircle", &Spheres::bindCircle)
+            .function("cull",       &Spheres::cull)
+            .function("visibleSize", &Spheres::visibleSize)
+            .function("visibleIndex", &Spheres::visibleIndex)
             .function("drawSolid",  &Spheres::drawSolid)
+            .function("drawSolidInstanced", &Spheres::drawSolidInstanced)
+            .function("drawImpostors", &Spheres::drawImpostors)
             .function("drawWire",   &Spheres::drawWire)
             .function("drawCircle", &Spheres::drawCircle)
             .function("drawArrow",  &Spheres::drawArrow)
@@ -1,5 +1,6 @@
 #include <planetsuniverse.h>
 #include <planet.h>
+#include <trailbuffer.h>
 #include "glbindings.h"
 
 /* Wrap addPlanet to avoid having to create an instance of Planet in JS,
@@ -35,25 +36,59 @@ float getPlanetRadius(PlanetsUniverse& universe, key_type key) {
 }
 void setPlanetPosition(PlanetsUniverse& universe, key_type key, glm::vec3 pos) {
     universe[key].position = pos;
+    universe.edited();
 }
 void setPlanetVelocity(PlanetsUniverse& universe, key_type key, glm::vec3 vel) {
     universe[key].velocity = vel;
+    universe.edited();
 }
 void setPlanetMass(PlanetsUniverse& universe, key_type key, float mass) {
     universe[key].setMass(mass);
+    universe.edited();
 }
 
+/* Every trail lives in one buffer, only the points that changed get uploaded each frame. */
+static GLuint trailVBO = 0;
+static TrailBuffer trailBuffer;
+
 void drawTrails(PlanetsUniverse& universe) {
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (trailVBO == 0)
+        glGenBuffers(1, &trailVBO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    for (const auto& i : universe) {
-        glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, 0, i.path.data());
-        glDrawArrays(GL_LINE_STRIP, 0, GLsizei(i.path.size()));
-    }
+    if (trailBuffer.update(universe))
+        glBufferData(GL_ARRAY_BUFFER, trailBuffer.size() * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+
+    for (const TrailBuffer::Upload& upload : trailBuffer.uploads)
+        glBufferSubData(GL_ARRAY_BUFFER, upload.offset * sizeof(glm::vec3), upload.count * sizeof(glm::vec3), upload.data);
+
+    glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    /* WebGL doesn't have glMultiDrawArrays, but at least nothing comes from client memory any more. */
+    for (size_t i = 0; i < trailBuffer.firsts.size(); ++i)
+        glDrawArrays(GL_LINE_STRIP, trailBuffer.firsts[i], trailBuffer.counts[i]);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 EMSCRIPTEN_BINDINGS(planets_universe) {
+    emscripten::enum_<PlanetsUniverse::ForceBackend>("ForceBackend")
+            .value("DirectSum",     PlanetsUniverse::DirectSum)
+            .value("BarnesHut",     PlanetsUniverse::BarnesHut)
+            .value("FastMultipole", PlanetsUniverse::FastMultipole)
+            ;
+    emscripten::enum_<PlanetsUniverse::Integrator>("Integrator")
+            .value("SemiImplicitEuler", PlanetsUniverse::SemiImplicitEuler)
+            .value("Leapfrog",          PlanetsUniverse::Leapfrog)
+            .value("Yoshida4",          PlanetsUniverse::Yoshida4)
+            ;
+    emscripten::enum_<PlanetsUniverse::PathRecording>("PathRecording")
+            .value("EveryStep",     PlanetsUniverse::EveryStep)
+            .value("EveryFrame",    PlanetsUniverse::EveryFrame)
+            .value("EveryInterval", PlanetsUniverse::EveryInterval)
+            ;
     emscripten::class_<PlanetsUniverse>("PlanetsUniverse")
             .constructor()
             .function("addPlanet",              &createPlanet)
@@ -80,15 +115,31 @@ EMSCRIPTEN_BINDINGS(planets_universe) {
             .function("isEmpty",                &PlanetsUniverse::isEmpty)
             .function("isSelectedValid",        &PlanetsUniverse::isSelectedValid)
             .function("isValid",                &PlanetsUniverse::isValid)
+            .function("keyAt",                  &PlanetsUniverse::keyAt)
+            .function("indexOf",                &PlanetsUniverse::indexOf)
+            .function("interpolation",          &PlanetsUniverse::interpolation)
             .function("remove",                 &PlanetsUniverse::remove)
             .function("resetSelected",          &PlanetsUniverse::resetSelected)
             .function("size",                   &PlanetsUniverse::size)
+            .property("barnesHutTheta",         &PlanetsUniverse::barnesHutTheta)
+            .property("fixedStep",              &PlanetsUniverse::fixedStep)
+            .property("fixedTimestep",          &PlanetsUniverse::fixedTimestep)
             .property("following",              &PlanetsUniverse::following)
+            .property("forceBackend",           &PlanetsUniverse::forceBackend)
+            .property("integrator",             &PlanetsUniverse::integrator)
+            .property("maxFixedSteps",          &PlanetsUniverse::maxFixedSteps)
+            .property("multipoleOrder",         &PlanetsUniverse::multipoleOrder)
+            .property("multipoleTheta",         &PlanetsUniverse::multipoleTheta)
             .property("pathLength",             &PlanetsUniverse::pathLength)
+            .property("pathRecordAngle",        &PlanetsUniverse::pathRecordAngle)
             .property("pathRecordDistance",     &PlanetsUniverse::pathRecordDistance)
+            .property("pathRecordInterval",     &PlanetsUniverse::pathRecordInterval)
+            .property("pathRecording",          &PlanetsUniverse::pathRecording)
             .property("selected",               &PlanetsUniverse::selected)
             .property("speed",                  &PlanetsUniverse::simspeed)
             .property("stepsPerFrame",          &PlanetsUniverse::stepsPerFrame)
+            .property("timestepAccuracy",       &PlanetsUniverse::timestepAccuracy)
+            .property("timestepLevels",         &PlanetsUniverse::timestepLevels)
             .property("velocityfac",            &PlanetsUniverse::velocityfac)
             ;
 }
@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef EMSCRIPTEN
+
+#include "types.h"
+#include "planetsuniverse.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Saves universes on a thread of its own, so writing a big file never holds up drawing or the simulation.
+ * Saving only takes a snapshot on the calling thread, which is a few array copies, and the file gets written from that.
+ * Each file is written under a temporary name first and then renamed, so a half written file never replaces a good one.
+ *
+ * Can also autosave every so often, going around a few files so there's always an older one if the newest is bad. */
+class BackgroundSaver {
+public:
+    /* How a save went, error is empty if it worked. */
+    struct Result {
+        std::string filename;
+        std::string error;
+    };
+
+    EXPORT BackgroundSaver();
+    /* Finishes any saves that are still waiting first. */
+    EXPORT ~BackgroundSaver();
+
+    BackgroundSaver(const BackgroundSaver&) = delete;
+    BackgroundSaver& operator = (const BackgroundSaver&) = delete;
+
+    /* Copy the universe and its paths, then write them to the file in the background. The format goes by the file name,
+     * like PlanetsUniverse::save(). */
+    EXPORT void save(const PlanetsUniverse& universe, const std::string& filename);
+
+    /* Is anything still waiting to be written? */
+    EXPORT bool isBusy();
+    /* Wait until everything has been written. */
+    EXPORT void wait();
+
+    /* Take how every save finished since the last call went, oldest first. Meant to be checked once a frame by the UI. */
+    EXPORT std::vector<Result> results();
+
+    /* Seconds of real time between autosaves, 0 never autosaves. */
+    float autosaveInterval = 0.0f;
+    /* Autosaves go to this followed by -1, -2 and so on up to autosaveCount, and the binary extension.
+     * Each one replaces whichever is oldest. */
+    std::string autosavePrefix = "autosave";
+    int autosaveCount = 3;
+
+    /* Call once a frame. Starts an autosave if autosaveInterval has passed since the last one, returning true if it did.
+     * Empty universes aren't saved, and neither is anything while the last save is still being written. */
+    EXPORT bool autosave(const PlanetsUniverse& universe);
+
+private:
+    struct Job {
+        std::shared_ptr<PlanetsUniverse::Snapshot> snapshot;
+        std::string filename;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+    std::deque<Job> jobs;
+    std::vector<Result> finished;
+    /* Whether the worker is in the middle of a job that's already been taken off the queue. */
+    bool writing = false;
+    bool quit = false;
+
+    std::chrono::steady_clock::time_point lastAutosave;
+
+    void run();
+
+    /* The autosave file that was written longest ago, or the first one that doesn't exist yet. */
+    std::string nextAutosave() const;
+};
+
+#endif
@@ -65,4 +65,11 @@ public:
     inline void followWeightedAverage() { followingState = WeightedAverage; }
 
     EXPORT glm::ivec2 getCenterScreen() const;
+
+    /* Where the camera is, and which way is up on screen, in world space. Only up to date after setup(). */
+    EXPORT glm::vec3 getEye() const;
+    EXPORT glm::vec3 getUp() const;
+
+    /* [0, 0, Width, Height] (in pixels). */
+    inline const glm::vec4& getViewport() const { return viewport; }
 };
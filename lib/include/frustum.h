@@ -0,0 +1,30 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+/* The part of space a camera matrix can see, as six planes facing inwards: left, right, bottom, top, near and far. */
+class Frustum {
+public:
+    /* The normal in xyz and the distance in w, normalized so a point's distance from a plane is dot(plane, (point, 1)). */
+    glm::vec4 planes[6];
+
+    Frustum() = default;
+    EXPORT explicit Frustum(const glm::mat4& camera);
+
+    /* Is any part of the sphere inside? Spheres right next to a corner can pass without being seen, but nothing seen ever fails. */
+    inline bool intersects(const glm::vec3& center, float radius) const {
+        for (const glm::vec4& plane : planes)
+            if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+                return false;
+
+        return true;
+    }
+
+    /* Add the index of every sphere in [begin, end) that intersects, with every radius multiplied by scale, to visible.
+     * Uses SSE to test four planes at a time where it can. */
+    EXPORT void cull(const glm::vec3* centers, const float* radii, size_t begin, size_t end, float scale, std::vector<uint32_t>& visible) const;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <glm/vec3.hpp>
+
+/* Calculates gravity between every pair of bodies several at a time, using the widest vector instructions the CPU has. */
+class GravityKernel {
+public:
+    enum InstructionSet {
+        /* One body at a time, for CPUs without any vector instructions we know about. */
+        Scalar,
+        /* 4 bodies at a time, every x86-64 CPU has these. */
+        SSE,
+        /* 8 bodies at a time. */
+        AVX2,
+        /* 16 bodies at a time. */
+        AVX512
+    };
+
+    /* The best instruction set this CPU supports. */
+    EXPORT static InstructionSet detect();
+
+    /* A readable name for the instruction set. */
+    EXPORT static const char* name(InstructionSet set);
+
+    /* Copy the bodies into the kernel's own arrays, padded out so the kernel never needs to handle a partial group. */
+    EXPORT void load(const glm::vec3* positions, const float* masses, const float* radii, size_t count);
+
+    /* Or add the bodies one at a time, calling finish() once they're all in. */
+    inline void clear() {
+        x.clear(); y.clear(); z.clear(); mass.clear(); radius.clear();
+        count = 0;
+    }
+    inline void add(const glm::vec3& position, float bodyMass, float bodyRadius) {
+        x.push_back(position.x); y.push_back(position.y); z.push_back(position.z);
+        mass.push_back(bodyMass); radius.push_back(bodyRadius);
+        ++count;
+    }
+    EXPORT void finish();
+
+    inline size_t size() const { return count; }
+
+    /* For each body in the list, get the sum of mass / distance^2 in the direction of every other loaded body.
+     * (Multiply by the gravity constant for an acceleration.) Bodies close enough to merge are skipped.
+     * Results go in the same order as the list. If encounters isn't null, it gets the largest (mass + other mass) / distance^3
+     * out of any pair, which is 1 / (gravity constant * time^2) for the time scale of the closest encounter.
+     * Never use a set higher than detect() returns. */
+    EXPORT void accumulate(InstructionSet set, const uint32_t* bodies, size_t count, glm::vec3* accelerations, float* encounters = nullptr) const;
+
+private:
+    std::vector<float> x, y, z, mass, radius;
+    size_t count = 0;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+#include <string>
+
+/* A whole file mapped into memory to read from, so big files can be copied straight out of the page cache
+ * instead of through a buffer first. Empty files and files that can't be opened just aren't open. */
+class MappedFile {
+public:
+    EXPORT explicit MappedFile(const std::string& filename);
+    EXPORT ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    inline bool isOpen() const { return data_p != nullptr; }
+    inline const char* data() const { return data_p; }
+    inline size_t size() const { return size_p; }
+
+private:
+    const char* data_p = nullptr;
+    size_t size_p = 0;
+
+#ifdef _WIN32
+    /* The file and mapping handles, both have to stay open while the view is. */
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "types.h"
+#include "octree.h"
+#include "gravitykernel.h"
+#include "threadpool.h"
+#include <utility>
+#include <vector>
+#include <glm/vec3.hpp>
+
+/* Calculates gravity with the fast multipole method. Like Barnes-Hut, groups of bodies that are far enough away get approximated,
+ * but here a whole group feels a whole other group at once through Cartesian Taylor expansions, which then get passed down the tree
+ * to each body. The work ends up proportional to the number of bodies, instead of n log n or n^2. */
+class MultipoleTree {
+public:
+    /* Expansions can go up to this order. The amount of work goes up with about the sixth power of it, so there's no point going higher. */
+    static const int maxOrder = 8;
+
+    /* Bodies in a node at or below this count won't be split any further. Nearby leaves are handled body by body with
+     * the vectorized kernel, so this trades the cost of that against the cost of more expansions. */
+    uint32_t leafSize = 64;
+
+    /* Get the sum of mass / distance^2 in the direction of every other body for every body, in the same order as the input.
+     * (Multiply by the gravity constant for an acceleration.) Bodies close enough to merge are skipped.
+     * Two groups are only approximated if the sum of their sizes is less than theta * the distance between them.
+     * The order is clamped to [1, maxOrder], every extra order makes the error about theta times smaller.
+     * Nearby bodies are done with the instruction set, which can't be higher than GravityKernel::detect() returns. */
+    EXPORT void solve(const glm::vec3* positions, const float* masses, const float* radii, size_t count,
+                      int order, float theta, GravityKernel::InstructionSet set, ThreadPool& pool, glm::vec3* accelerations);
+
+private:
+    /* The powers of x, y and z in one term of an expansion, and their sum. */
+    struct Term {
+        uint8_t x, y, z, order;
+    };
+
+    /* Part of working out one term from an earlier one: the earlier term times this factor, times the vector's component
+     * on this axis. Axis 3 leaves the vector out. */
+    struct Step {
+        uint32_t source, axis;
+        double factor;
+    };
+
+    /* A pair of terms that add up to a third one. Shifting, translating and combining expansions is all just a sum over these. */
+    struct Product {
+        uint32_t sum, a, b;
+    };
+
+    int order = 0;
+    std::vector<Term> terms;
+
+    /* One step for each term after the first. */
+    std::vector<Step> powerSteps;
+    /* Up to six steps for each term after the first, starting at derivativeStart[term]. */
+    std::vector<Step> derivativeSteps;
+    std::vector<uint32_t> derivativeStart;
+
+    /* Sorted by b, with the products for each b starting at productStart[b]. */
+    std::vector<Product> products;
+    std::vector<uint32_t> productStart;
+
+    /* For each axis, the terms that get one more power in it without going past the order, and the term they turn into. */
+    std::vector<std::pair<uint32_t, uint32_t>> raise[3];
+
+    Octree tree;
+
+    /* The expansions of every node, terms() values each. The expansion center is the node's center of mass. */
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+    /* The distance from each node's center of mass to the furthest edge of any body in it. */
+    std::vector<float> nodeRadius;
+
+    /* Which pairs of nodes get approximated, and which have to be done body by body. Both are sorted by the node feeling the force. */
+    std::vector<std::pair<uint32_t, uint32_t>> approximated;
+    std::vector<std::pair<uint32_t, uint32_t>> direct;
+    std::vector<uint32_t> approximatedStart;
+    std::vector<uint32_t> directStart;
+
+    std::vector<uint32_t> leaves;
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+
+    /* Each thread gathers the bodies near a leaf into its own kernel. */
+    struct Nearby {
+        GravityKernel kernel;
+        std::vector<uint32_t> bodies;
+        std::vector<glm::vec3> accelerations;
+    };
+    std::vector<Nearby> nearby;
+
+    /* Rebuild the term tables if the order changed. */
+    void setOrder(int order);
+
+    /* Fill powers with d^term / term! for every term. */
+    void powers(const glm::dvec3& d, double* result) const;
+
+    /* Fill result with the derivatives of 1 / |r| for every term. */
+    void derivatives(const glm::dvec3& r, double* result) const;
+
+    /* Go through every pair of nodes, splitting them up until they can either be approximated or are leaves. */
+    void findInteractions(float theta);
+
+    /* Sort the pairs by the first node, and fill start with where each node's pairs start. */
+    static void sortByTarget(std::vector<std::pair<uint32_t, uint32_t>>& pairs, std::vector<uint32_t>& start, size_t nodes);
+};
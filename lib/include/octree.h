@@ -0,0 +1,57 @@
+#pragma once
+
+#include "types.h"
+#include <vector>
+#include <glm/vec3.hpp>
+
+/* A Barnes-Hut octree, rebuilt from scratch every time the bodies move. */
+class Octree {
+public:
+    struct Body {
+        glm::vec3 position;
+        float mass;
+        float radius;
+        /* The index of the body in the list it was copied from, bodies get reordered when building. */
+        uint32_t index;
+    };
+
+    struct Node {
+        glm::vec3 centerOfMass;
+        float mass;
+
+        /* The geometric center and half the side length of the node's cube. */
+        glm::vec3 center;
+        float halfSize;
+
+        /* The range of bodies contained in this node and all of its children. */
+        uint32_t first, count;
+
+        /* Only non-empty children are stored, all next to each other. A leaf has no children. */
+        uint32_t firstChild, childCount;
+    };
+
+    /* Fill this before calling build(). */
+    std::vector<Body> bodies;
+    std::vector<Node> nodes;
+
+    /* Bodies in a node at or below this count won't be split any further. */
+    uint32_t leafSize = 8;
+
+    /* Stop splitting at this depth, in case a bunch of bodies are on top of each other. */
+    static const uint32_t maxDepth = 32;
+
+    /* Sort the bodies into a new tree. */
+    EXPORT void build();
+
+    /* Get the sum of mass / distance^2 in the direction of every other body, as seen from the body at the specified tree position.
+     * Nodes are approximated when their size / distance is less than theta. (Multiply by the gravity constant for an acceleration.)
+     * Bodies close enough to merge are skipped, as they won't be around to feel the force anyway.
+     * If encounter isn't null, it gets the largest (mass + other mass) / distance^3 out of every body or node used. */
+    EXPORT glm::vec3 acceleration(uint32_t body, float theta, float* encounter = nullptr) const;
+
+private:
+    /* Temporary storage for partitioning bodies between octants. */
+    std::vector<Body> sortBuffer;
+
+    void buildNode(uint32_t node, uint32_t depth);
+};
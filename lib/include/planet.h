@@ -1,7 +1,7 @@
 #pragma once
 
 #include "types.h"
-#include <vector>
+#include "trail.h"
 #include <glm/vec3.hpp>
 
 class Planet {
@@ -15,11 +15,6 @@ public:
     glm::vec3 position;
     glm::vec3 velocity;
 
-    std::vector<glm::vec3> path;
-
-    /* Add a point to the path if the planet is specified distance (in units squared) from the last point. */
-    void updatePath(size_t pathLength, float pathRecordDistance);
-
     /* Automatically set based on planet mass. */
     inline float radius() const { return radius_p; }
 
@@ -27,4 +22,47 @@ public:
     EXPORT void setMass(const float& m);
 
     inline float mass() const { return mass_p; }
+
+    /* The radius of a planet with the specified mass. */
+    EXPORT static float radiusFromMass(const float& m);
+};
+
+/* Add a point to the path if the planet is specified distance (in units squared) from the last point, and the direction
+ * from the last point has turned away from the last segment by an angle with a cosine below pathRecordCosine.
+ * Otherwise the last point just follows the planet. A cosine of 1 adds a point whenever it's far enough. */
+void updatePath(Trail& path, const glm::vec3& position, size_t pathLength, float pathRecordDistance, float pathRecordCosine = 1.0f);
+
+/* A planet stored inside a PlanetsUniverse, which keeps each property in its own array.
+ * Works like a reference to a Planet, so copies of it still change the same planet. */
+template <typename Vec3, typename Float, typename Path> class BasicPlanetRef {
+private:
+    Float& mass_p;
+    Float& radius_p;
+
+public:
+    Vec3& position;
+    Vec3& velocity;
+
+    /* The trail of points this planet has left behind. */
+    Path& path;
+
+    BasicPlanetRef(Vec3& p, Vec3& v, Float& m, Float& r, Path& t) : mass_p(m), radius_p(r), position(p), velocity(v), path(t) { }
+
+    /* Allow converting a non-const reference to a const one. */
+    template <typename V, typename F, typename P> BasicPlanetRef(const BasicPlanetRef<V, F, P>& other)
+        : mass_p(other.mass_p), radius_p(other.radius_p), position(other.position), velocity(other.velocity), path(other.path) { }
+
+    inline float radius() const { return radius_p; }
+    inline float mass() const { return mass_p; }
+
+    /* Set the planet's mass and update the radius. */
+    inline void setMass(const float& m) { mass_p = m; radius_p = Planet::radiusFromMass(m); }
+
+    /* Copy the planet out of the universe. */
+    inline operator Planet() const { return Planet(position, velocity, mass_p); }
+
+    template <typename V, typename F, typename P> friend class BasicPlanetRef;
 };
+
+typedef BasicPlanetRef<glm::vec3, float, Trail> PlanetRef;
+typedef BasicPlanetRef<const glm::vec3, const float, const Trail> ConstPlanetRef;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+#include "planetsuniverse.h"
+#include "spheregenerator.h"
+#include "frustum.h"
+#include <vector>
+#include <glm/vec4.hpp>
+
+/* The per-planet data for drawing every planet with one instanced draw call per level of detail. The renderer uploads it
+ * as a vertex attribute that advances once per instance, and the sphere mesh gets scaled and moved by it. */
+class PlanetInstances {
+public:
+    static const int levels = SphereLevels::levels;
+
+    /* How many pixels a planet's radius has to cover on screen to be drawn with each level of SphereLevels.
+     * Anything smaller than the last one is drawn as a point. */
+    float levelPixels[levels - 1] = { 24.0f, 12.0f, 5.0f, 1.0f };
+
+    /* Leave out planets the camera can't see. */
+    bool cull = true;
+
+    /* The index of every planet that made it past culling, in the order they're stored. */
+    std::vector<uint32_t> visible;
+
+    /* The position of each planet, with its radius in w. Grouped by level, starting at levelStart[level]. */
+    std::vector<glm::vec4> instances;
+    size_t levelStart[levels + 1] = {};
+
+    /* Fill instances from every planet the camera can see, with every radius multiplied by scale, and pick a level
+     * for each one based on how big it looks from the camera. The camera has to be set up already. */
+    EXPORT void update(const PlanetsUniverse& universe, const Camera& camera, float scale = 1.0f);
+
+    inline size_t size() const { return instances.size(); }
+    inline size_t levelSize(int level) const { return levelStart[level + 1] - levelStart[level]; }
+
+private:
+    std::vector<uint8_t> planetLevels;
+    std::vector<glm::vec3> interpolated;
+};
@@ -1,39 +1,276 @@
 #pragma once
 
 #include "types.h"
+#include "planet.h"
+#include "octree.h"
+#include "gravitykernel.h"
+#include "multipoletree.h"
+#include "threadpool.h"
+#include "slotmap.h"
+#include <functional>
+#include <iterator>
 #include <map>
 #include <random>
+#include <stdexcept>
 #include <string>
 #include <glm/mat4x4.hpp>
 
-#ifdef EMSCRIPTEN
-#include "planet.h"
-#endif
+class MappedFile;
 
 class PlanetsUniverse {
 public:
-    typedef std::vector<Planet> list_type;
-    typedef list_type::iterator iterator;
-    typedef list_type::const_iterator const_iterator;
+    typedef size_t size_type;
+
+    /* Goes through the planets in the order they're stored, giving a PlanetRef or ConstPlanetRef for each one.
+     * The order changes whenever planets are removed, so only keys should be kept around. */
+    template <typename Universe, typename Ref> class basic_iterator {
+        Universe* universe;
+        size_type index;
+
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Planet value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Ref reference;
+
+        /* There is no actual Planet to point at, so this holds the reference for operator->. */
+        struct pointer {
+            Ref ref;
+            inline Ref* operator -> () { return &ref; }
+        };
+
+        basic_iterator(Universe* u = nullptr, size_type i = 0) : universe(u), index(i) { }
+
+        /* Allow converting an iterator to a const_iterator. */
+        template <typename U, typename R> basic_iterator(const basic_iterator<U, R>& other) : universe(other.universe), index(other.index) { }
+
+        /* The key of the planet this iterator is on. */
+        inline key_type key() const { return universe->slots.key(index); }
+
+        inline Ref operator * () const { return universe->refAt(index); }
+        inline pointer operator -> () const { return pointer{ universe->refAt(index) }; }
+        inline Ref operator [] (difference_type n) const { return universe->refAt(index + n); }
+
+        inline basic_iterator& operator ++ () { ++index; return *this; }
+        inline basic_iterator& operator -- () { --index; return *this; }
+        inline basic_iterator operator ++ (int) { basic_iterator old = *this; ++index; return old; }
+        inline basic_iterator operator -- (int) { basic_iterator old = *this; --index; return old; }
+        inline basic_iterator& operator += (difference_type n) { index += n; return *this; }
+        inline basic_iterator& operator -= (difference_type n) { index -= n; return *this; }
+        inline basic_iterator operator + (difference_type n) const { return basic_iterator(universe, index + n); }
+        inline basic_iterator operator - (difference_type n) const { return basic_iterator(universe, index - n); }
+        inline difference_type operator - (const basic_iterator& other) const { return difference_type(index) - difference_type(other.index); }
+
+        inline bool operator == (const basic_iterator& other) const { return index == other.index; }
+        inline bool operator != (const basic_iterator& other) const { return index != other.index; }
+        inline bool operator < (const basic_iterator& other) const { return index < other.index; }
+        inline bool operator > (const basic_iterator& other) const { return index > other.index; }
+        inline bool operator <= (const basic_iterator& other) const { return index <= other.index; }
+        inline bool operator >= (const basic_iterator& other) const { return index >= other.index; }
+
+        template <typename U, typename R> friend class basic_iterator;
+    };
+
+    typedef basic_iterator<PlanetsUniverse, PlanetRef> iterator;
+    typedef basic_iterator<const PlanetsUniverse, ConstPlanetRef> const_iterator;
 
 private:
-    list_type planets;
+    /* Planets are stored as a structure of arrays, so the simulation only pulls in the data it actually uses.
+     * The arrays never have gaps in them, the slot map keeps track of where each key's planet is. */
+    SlotMap slots;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<float> masses;
+    std::vector<float> radii;
+
+    /* Paths are only used for drawing, so they are kept out of the way of everything else. */
+    std::vector<Trail> paths;
+
+    /* Get a reference to the planet at a position in the arrays. */
+    inline PlanetRef refAt(const size_type& i) { return PlanetRef(positions[i], velocities[i], masses[i], radii[i], paths[i]); }
+    inline ConstPlanetRef refAt(const size_type& i) const { return ConstPlanetRef(positions[i], velocities[i], masses[i], radii[i], paths[i]); }
+
+    /* Remove the planet at a position in the arrays by moving the last planet into its place. */
+    void removeAt(const size_type index, const key_type replacement);
 
     std::default_random_engine generator;
 
+    /* Kept around between steps so the allocations can be reused. */
+    Octree octree;
+    GravityKernel kernel;
+    MultipoleTree multipoleTree;
+    std::vector<glm::vec3> accelerations;
+
+    ThreadPool pool;
+    /* Each thread adds to its own copy, so nothing needs to be locked. */
+    std::vector<std::vector<glm::vec3>> threadAccelerations;
+    std::vector<std::pair<uint32_t, uint32_t>> tilePairs;
+
+    /* Used for finding and merging overlapping planets. */
+    std::vector<std::pair<uint32_t, uint32_t>> merges;
+    std::vector<float> sweepStart;
+    std::vector<uint32_t> sweepOrder;
+    std::vector<uint32_t> mergeParent;
+
+    /* The planets to calculate gravity for when not all of them need it, and the results for each one in the same order. */
+    std::vector<uint32_t> active;
+    std::vector<float> encounters;
+    /* Where each planet ended up in the octree. */
+    std::vector<uint32_t> treeIndex;
+
+    /* The timestep level of each planet, and the half step of gravity it still has coming once its step ends.
+     * Only used while advancing with block timesteps, empty the rest of the time. */
+    std::vector<uint8_t> levels;
+    std::vector<float> halfSteps;
+    std::vector<size_t> occupancy;
+    /* The planets on each level, so a tick only goes through the ones taking a step. */
+    std::vector<std::vector<uint32_t>> onLevel;
+
+    /* Add one step's worth of gravity to the velocity of every planet, with each method of calculating it.
+     * Planets overlapping each other are skipped, they'll be merged before they move. */
+    void gravityDirect(float gconsttime);
+    void gravityDirectParallel(float gconsttime);
+    void gravityVectorized(GravityKernel::InstructionSet set, float gconsttime);
+    void gravityBarnesHut(float gconsttime);
+    void gravityMultipole(GravityKernel::InstructionSet set, float gconsttime);
+
+    /* Fill accelerations and encounters for every planet in the active list, using whichever backend is set.
+     * (Multiply the acceleration by the gravity constant, see GravityKernel::accumulate for what an encounter is.)
+     * The fast multipole method can only do every planet at once, so it uses Barnes-Hut here instead. */
+    void gravityActive(GravityKernel::InstructionSet set);
+
+    /* Fill the merges list with every pair of overlapping planets, lowest index first. */
+    void findMerges();
+
+    /* Merge every group of planets connected by the merges list into the lowest planet of the group,
+     * then remove the rest of the planets all at once. */
+    void resolveMerges();
+
+    /* Combine the mass and momentum of the other planet into the first one. Doesn't remove the other planet. */
+    void merge(const size_type& into, const size_type& other);
+
+    /* Update the velocities with the gravity over the specified amount of time, then merge anything overlapping. */
+    void kick(GravityKernel::InstructionSet set, float time);
+
+    /* Apply the velocity to the position of every planet. */
+    void drift(float time);
+
+    /* How much simulated time has passed since the paths were last updated with EveryInterval. */
+    float pathTime = 0.0f;
+
+    /* Update the paths if the recording policy calls for it after a step of the specified length. */
+    void recordPaths(float time, bool lastStep);
+
+    /* Goes up with every edit, see editCount(). */
+    uint64_t edits = 0;
+    /* Where loadSnapshot() puts the paths while they get moved to their planets' new places. */
+    std::vector<Trail> pathScratch;
+
+#ifndef EMSCRIPTEN
+    /* The two halves of load(), and the binary half of save(). */
+    int loadXml(const MappedFile& file, const std::string& filename, bool clear, const std::function<bool(float)>& progress);
+    int loadBinary(const MappedFile& file, const std::string& filename, bool clear);
+    void saveBinary(const std::string& filename) const;
+#endif
+
+    /* Advance with each planet using its own step, see timestepLevels. Time is the length of each of the steps. */
+    void advanceBlocks(GravityKernel::InstructionSet set, float time, int steps);
+
+    /* Simulated time saved up for the next fixed step, see fixedTimestep. */
+    double accumulator = 0.0;
+    /* Where the planets were before the last step, and the edit count at the time. Only usable while both still match. */
+    std::vector<glm::vec3> previousPositions;
+    uint64_t previousEdits = 0;
+    float alpha = 1.0f;
+
+    /* Copy the positions into previousPositions, just before the last step of a fixed timestep advance(). */
+    void savePrevious();
+
 public:
+    enum ForceBackend {
+        /* Calculate the force between every pair of planets. */
+        DirectSum,
+        /* Group far away planets in an octree, much faster for large amounts of planets. */
+        BarnesHut,
+        /* Approximate far away groups against each other instead of against each planet, for hundreds of thousands of planets. */
+        FastMultipole
+    };
+
+    enum Integrator {
+        /* Update the velocity, then move with the new velocity. First order, but it's what Planets3D always used. */
+        SemiImplicitEuler,
+        /* Move half a step, update the velocity, then move the other half. Second order for the same amount of work. */
+        Leapfrog,
+        /* Yoshida's combination of three leapfrog steps, fourth order. Calculates gravity three times per step. */
+        Yoshida4
+    };
+
+    /* Things that would stay the same forever if the simulation had no error. Compare them before and after advancing
+     * to see how much error builds up. Merging loses energy, so energy can only be compared if nothing merged. */
+    struct ConservedQuantities {
+        double energy;
+        glm::dvec3 momentum;
+        glm::dvec3 angularMomentum;
+    };
+
+    enum PathRecording {
+        /* Record after every one of the stepsPerFrame steps. */
+        EveryStep,
+        /* Record once at the end of each frame, so the cost doesn't depend on stepsPerFrame. */
+        EveryFrame,
+        /* Record whenever pathRecordInterval of simulated time has passed. */
+        EveryInterval
+    };
+
+    /* The planets, for handing a universe from one thread to another. See SimulationThread and BackgroundSaver. */
+    struct Snapshot {
+        SlotMap slots;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> velocities;
+        std::vector<float> masses;
+        std::vector<float> radii;
+        /* Only filled in when asked for, otherwise empty. */
+        std::vector<Trail> paths;
+        /* Where the planets were before the last step and how far to blend from there, see interpolation().
+         * Empty if there's nothing to blend. */
+        std::vector<glm::vec3> previousPositions;
+        float interpolation = 1.0f;
+    };
+
+    /* Seconds spent in each part of advance(), added up over every call. */
+    struct PhaseTimes {
+        /* Calculating gravity and applying it to the velocities. */
+        double gravity;
+        /* Moving the planets, and with block timesteps working out the steps. */
+        double integration;
+        /* Finding and merging overlapping planets. */
+        double merging;
+        /* Recording the paths. */
+        double paths;
+    };
+
     /* The gravity constant */
     const float gravityconst = 6.667e-11f;
     /* The factor for apparent velocity.
      * (UI velocity * this = actual velocity, because it would be really really small if done right.) */
     const float velocityfac = 1.0e-5f;
 
+    /* The most timestep levels allowed, any more would take forever to get through a frame anyway. */
+    static const int maxTimestepLevels = 16;
+
     /* UI limits on planet size. */
     const float min_mass = 1.0f;
     const float max_mass = 1.0e9f;
 
-    std::vector<glm::vec3>::size_type pathLength = 200;
+    /* How many points each path keeps. 0 stops recording, like in the copy a SimulationThread advances. */
+    size_t pathLength = 200;
     float pathRecordDistance = 0.25f;
+    /* When the paths get updated. A new point is only added once the planet is sqrt(pathRecordDistance) from the last one,
+     * and has turned by more than pathRecordAngle (in radians) since then, so straight stretches use fewer points. */
+    PathRecording pathRecording = EveryFrame;
+    float pathRecordInterval = 50.0f;
+    float pathRecordAngle = 0.02f;
 
     key_type selected = -1, following = -1;
 
@@ -42,16 +279,74 @@ public:
     /* How many sub-steps to perform per frame for better accuracy. */
     int stepsPerFrame = 20;
 
+    /* Take steps of fixedStep simulated time instead of splitting each frame into stepsPerFrame steps. Whatever time is
+     * left over after the last whole step gets saved up for the next advance(), so the steps taken don't depend on the
+     * frame rate, and the same settings always give the same run. The planets can then be drawn between their last two
+     * steps, see interpolation(). */
+    bool fixedTimestep = false;
+    /* The length of each step with fixedTimestep, in the same units as advance() after simspeed. */
+    float fixedStep = 1000.0f;
+    /* The most steps one advance() will take with fixedTimestep. Any time past that is dropped, so a frame that falls
+     * behind doesn't make the next one take even longer. */
+    int maxFixedSteps = 2000;
+
+    /* How gravity gets calculated. */
+    ForceBackend forceBackend = DirectSum;
+    /* The opening angle for Barnes-Hut, lower is more accurate but slower. 0 is equivalent to DirectSum. */
+    float barnesHutTheta = 0.5f;
+    /* How many terms FastMultipole keeps, from 1 to MultipoleTree::maxOrder. Higher is more accurate but slower. */
+    int multipoleOrder = 4;
+    /* FastMultipole only approximates two groups if their combined size is less than this times the distance between them. */
+    float multipoleTheta = 0.6f;
+    /* How each step moves the planets, higher order integrators can use much fewer steps for the same accuracy. */
+    Integrator integrator = SemiImplicitEuler;
+    /* The vector instructions DirectSum is allowed to use, anything above what the CPU supports is ignored.
+     * Scalar uses the original loop that only visits each pair once. */
+    GravityKernel::InstructionSet instructionSet = GravityKernel::detect();
+    /* How many threads to calculate gravity with, 0 uses one for every CPU core.
+     * The results only depend on this when using DirectSum with the Scalar instruction set, unless deterministic is set. */
+    unsigned int threadCount = 1;
+    /* Add up the gravity on each planet on its own and always in the same order, so the results never depend on threadCount.
+     * Only matters for DirectSum with the Scalar instruction set, which is slower this way since it can't use each pair twice.
+     * Results still depend on the instruction set. This doesn't touch the random generator, which is seeded from the clock,
+     * so call randSeed() when turning it on for generated planets to repeat too. The SDL interface does that with the seed
+     * next to its checkbox. */
+    bool deterministic = false;
+
+    /* Let each planet halve its step up to this many times, so only planets in close encounters pay for short steps.
+     * Every step is split into 2^timestepLevels ticks, and each planet only has its gravity calculated on the ticks
+     * that line up with its own step. Always integrates the same way as Leapfrog. 0 gives every planet the same step. */
+    int timestepLevels = 0;
+    /* A planet's step gets halved until it's below this fraction of 1 / sqrt(gravity constant * (mass + other mass) / distance^3)
+     * for its closest encounter. A circular orbit gets about 6.3 / timestepAccuracy steps. */
+    float timestepAccuracy = 0.05f;
+
+    /* How many times gravity has been calculated for a planet, over every call to advance(). Set it to 0 whenever. */
+    uint64_t forceEvaluations = 0;
+    /* Where the time in advance() went. Set it to {} whenever. */
+    PhaseTimes phaseTimes = {};
+
     /* Make new planets. */
-    inline key_type addPlanet(const Planet& planet) { planets.push_back(planet); return planets.size() - 1; }
+    EXPORT key_type addPlanet(const Planet& planet);
     EXPORT void generateRandom(const size_t& count, const float& positionRange, const float& maxVelocity, const float& maxMass);
-    EXPORT key_type addOrbital(Planet& around, const float& radius, const float& mass, const glm::mat4& plane);
+    EXPORT key_type addOrbital(const key_type around, const float& radius, const float& mass, const glm::mat4& plane);
     EXPORT void generateRandomOrbital(const size_t& count, key_type target);
 
 #ifndef EMSCRIPTEN
-    /* Load and save from an XML file. Sets error string and returns false on an error. */
+    /* Called every so often while loading with how much of the file has been read, from 0 to 1.
+     * Returning false stops loading, leaving the universe as it was. */
+    typedef std::function<bool(float)> LoadProgress;
+
+    /* Load and save a universe file, throwing std::runtime_error on an error. Load returns how many planets were loaded.
+     * Files ending in binaryExtension are saved in the binary format with their paths, anything else as XML.
+     * Loading works out which one a file is by itself. XML is read a tag at a time, nothing changes until it's all been read. */
     EXPORT void save(const std::string& filename);
-    EXPORT int load(const std::string& filename, bool clear = true);
+    EXPORT int load(const std::string& filename, bool clear = true, const LoadProgress& progress = LoadProgress());
+
+    /* The binary format is a fixed header followed by each array of planet data in turn, all little endian,
+     * so loading is a handful of copies straight out of the mapped file. XML is still best for anything else to read. */
+    static const char* const binaryExtension;
+    static const uint32_t binaryVersion = 1;
 #endif
 
     EXPORT PlanetsUniverse();
@@ -59,16 +354,44 @@ public:
     /* Advance the universe by the specified amount of time. */
     EXPORT void advance(float time);
 
-    inline bool isEmpty() const { return planets.size() == 0; }
-    /* As size_t is unsigned, any keys less than the universe size are valid and any others are not. */
-    inline bool isValid(const key_type& key) const { return key < planets.size(); }
-    inline Planet& operator [] (const key_type& key) { return planets.at(key); }
+    /* How far the time advanced to is between the last two steps, from 0 to 1. Only ever less than 1 with fixedTimestep. */
+    inline float interpolation() const { return alpha; }
+    /* Whether there are positions from before the last step to blend from, they're gone after any edit. */
+    inline bool canInterpolate() const { return previousEdits == edits && previousPositions.size() == positions.size(); }
+    /* Where a planet should be drawn, between where it was before the last step and where it is now. The key has to be valid. */
+    inline glm::vec3 interpolatedPosition(const key_type& key) const {
+        const size_type i = slots.index(key);
+        return canInterpolate() ? previousPositions[i] + (positions[i] - previousPositions[i]) * alpha : positions[i];
+    }
+    /* Fill positions with where every planet should be drawn, in the order they're stored. Returns positionData() instead
+     * when there's nothing to blend, without touching positions. */
+    EXPORT const glm::vec3* interpolatedPositions(std::vector<glm::vec3>& positions) const;
+
+    /* How many planets ended the last advance() on each timestep level, starting with the full step. */
+    inline const std::vector<size_t>& timestepOccupancy() const { return occupancy; }
+
+    /* Add up the total energy, momentum and angular momentum. Takes as long as a DirectSum step. */
+    EXPORT ConservedQuantities conservedQuantities() const;
+    /* A hash of every position, velocity and mass, bit for bit in the order they're stored. Two runs that give the same hash
+     * almost certainly did exactly the same thing. */
+    EXPORT uint64_t stateHash() const;
+
+    inline bool isEmpty() const { return positions.size() == 0; }
+    /* Keys stay valid until their planet is removed or merged into another one. */
+    inline bool isValid(const key_type& key) const { return slots.isValid(key); }
+    inline PlanetRef operator [] (const key_type& key) { if (!isValid(key)) throw std::out_of_range("Invalid planet key!"); return refAt(slots.index(key)); }
+    inline ConstPlanetRef operator [] (const key_type& key) const { if (!isValid(key)) throw std::out_of_range("Invalid planet key!"); return refAt(slots.index(key)); }
+    /* Remove a planet, anything selecting or following it will switch to the replacement. */
     EXPORT void remove(const key_type key, const key_type replacement = -1);
 
+    /* Convert between keys and positions in the order the planets are stored. The key has to be valid. */
+    inline key_type keyAt(const size_type& index) const { return slots.key(index); }
+    inline size_type indexOf(const key_type& key) const { return slots.index(key); }
+
     /* Is a planet selected? */
     inline bool isSelectedValid() const { return isValid(selected); }
     /* Get the currently selected planet. Don't call without checking for validity first. */
-    inline Planet& getSelected() { return planets[selected]; }
+    inline PlanetRef getSelected() { return refAt(slots.index(selected)); }
     /* Deselect the currently selected planet. */
     inline void resetSelected() { selected = -1; }
 
@@ -76,20 +399,53 @@ public:
     EXPORT key_type getRandomPlanet();
 
     /* Iterators and stuff. */
-    inline iterator begin() { return planets.begin(); }
-    inline iterator end() { return planets.end(); }
-    inline const_iterator cbegin() const { return planets.cbegin(); }
-    inline const_iterator cend() const { return planets.cend(); }
-    inline list_type::size_type size() const { return planets.size(); }
+    inline iterator begin() { return iterator(this, 0); }
+    inline iterator end() { return iterator(this, size()); }
+    inline const_iterator begin() const { return cbegin(); }
+    inline const_iterator end() const { return cend(); }
+    inline const_iterator cbegin() const { return const_iterator(this, 0); }
+    inline const_iterator cend() const { return const_iterator(this, size()); }
+    inline size_type size() const { return positions.size(); }
 
+    /* Every position, mass and radius in the order the planets are stored, for going through all of them without the refs. */
+    inline const glm::vec3* positionData() const { return positions.data(); }
+    inline const float* massData() const { return masses.data(); }
+    inline const float* radiusData() const { return radii.data(); }
+
+    /* Restart the generator behind generateRandom(), generateRandomOrbital() and getRandomPlanet() from seed. */
     inline void randSeed(unsigned int seed) { generator.seed(seed); }
 
+    /* Copy every planet into a snapshot, reusing the memory it already has. The paths are only copied if asked for. */
+    EXPORT void saveSnapshot(Snapshot& snapshot, bool withPaths = false) const;
+    /* Replace every planet with the ones in a snapshot. If the snapshot has paths they're used, otherwise the path of each planet
+     * that's still there is kept. Then record the paths as if advance() had just moved them by time, so a universe that only gets
+     * snapshots still has paths. */
+    EXPORT void loadSnapshot(const Snapshot& snapshot, float time = 0.0f);
+
+    /* Goes up whenever planets are added, removed, or moved by anything other than advance() and loadSnapshot(). */
+    inline uint64_t editCount() const { return edits; }
+    /* Count a change made straight through a PlanetRef as an edit. */
+    inline void edited() { ++edits; }
+
     /* Make the weighted average position and velocity of all planets 0.
      * After this if all the planets merged into one it would be stationary at the origin. */
     EXPORT void centerAll();
 
     /* Functions for destroying stuff. */
-    inline void deleteAll() { planets.clear(); resetSelected(); }
+    EXPORT void deleteAll();
     EXPORT void deleteEscapees();
     inline void deleteSelected() { if (isSelectedValid()) remove(selected); }
+
+private:
+    /* What the forces left in accelerations and encounters by the end of the last advanceBlocks() were calculated with.
+     * They're for every planet in order, right where the next advanceBlocks() starts, so it can use them if nothing changed. */
+    struct ClosingForces {
+        bool valid;
+        uint64_t edits;
+        size_type count;
+        GravityKernel::InstructionSet set;
+        ForceBackend forceBackend;
+        float barnesHutTheta;
+    };
+    ClosingForces closingForces = {};
 };
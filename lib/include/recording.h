@@ -0,0 +1,140 @@
+#pragma once
+
+#include "types.h"
+#include "planetsuniverse.h"
+#include "mappedfile.h"
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Turns frames of planets into bytes and back. Recorder and RecordingPlayer each keep one, and since every frame is
+ * predicted from the ones before it, both sides have to go through the same frames in the same order.
+ *
+ * Positions are rounded to a grid, and each planet is predicted to keep moving the way it moved over the last two frames.
+ * Only the difference from that is stored, along with any change to its mass, and all of it goes through an adaptive
+ * range coder. Keyframes don't use anything from before them, so playback can start from any of them. */
+class RecordingCodec {
+public:
+    /* The grid positions are rounded to, in units. */
+    EXPORT explicit RecordingCodec(float quantum);
+
+    /* Add a frame to the end of out. */
+    EXPORT void encode(const key_type* keys, const glm::vec3* positions, const float* masses, size_t count, bool keyframe, std::vector<uint8_t>& out);
+    /* Read the next frame into keys, positions and masses. Throws std::runtime_error if the data doesn't make sense. */
+    EXPORT void decode(const uint8_t* data, size_t size, size_t count, bool keyframe);
+
+    inline float quantum() const { return quantum_p; }
+
+    /* The last frame that went through, either way. */
+    std::vector<key_type> keys;
+    std::vector<glm::vec3> positions;
+    std::vector<float> masses;
+
+private:
+    /* What happened to the planet in a slot over the last two frames it was in. Frames are counted from 1, so 0 is never. */
+    struct Track {
+        key_type key = 0;
+        uint32_t seen = 0;
+        uint32_t seenBefore = 0;
+        int64_t last[3];
+        int64_t before[3];
+        uint32_t massBits = 0;
+    };
+
+    float quantum_p;
+    std::vector<Track> tracks;
+    /* The frame being coded and the last keyframe. */
+    uint32_t frame = 0;
+    uint32_t keyframeAt = 0;
+
+    std::vector<int64_t> quantized;
+
+    /* Move on to the next frame and make sure there's a track for every slot in it. */
+    void beginFrame(const key_type* frameKeys, size_t count, bool keyframe);
+    /* Where the planet is expected to be in this frame, and the bits of its mass, from its track. */
+    void predict(key_type key, int64_t* position, uint32_t& massBits) const;
+    void remember(key_type key, const int64_t* position, uint32_t massBits);
+};
+
+/* Writes the state of a universe to a file every so often, so it can be played back later without simulating it again.
+ * Saves positions and masses, not velocities, which is all that's needed to watch it. */
+class Recorder {
+public:
+    /* Start a new recording, replacing whatever is in the file. Throws std::runtime_error if it can't be written.
+     * Positions are stored to the nearest quantum units. */
+    EXPORT explicit Recorder(const std::string& filename, float quantum = 1.0f / 1024.0f);
+
+    /* Only every this many calls to record() writes a frame. */
+    int every = 1;
+    /* Every this many frames is a keyframe, which playback can jump straight to. */
+    int keyframeInterval = 100;
+
+    /* Call every time the universe has been advanced, with the simulated time in seconds. Returns true if a frame was written. */
+    EXPORT bool record(const PlanetsUniverse& universe, double time);
+
+    /* Make sure everything recorded so far is in the file. */
+    EXPORT void flush();
+
+    inline size_t frames() const { return frameCount; }
+    inline uint64_t bytes() const { return written; }
+
+private:
+    std::ofstream file;
+    RecordingCodec codec;
+
+    std::vector<key_type> keys;
+    std::vector<uint8_t> buffer;
+
+    int calls = 0;
+    size_t frameCount = 0;
+    uint64_t written = 0;
+};
+
+/* Plays back a file written by Recorder, jumping to any frame in it. */
+class RecordingPlayer {
+public:
+    /* Throws std::runtime_error if the file isn't a recording. One that was cut off part way plays up to its last whole frame. */
+    EXPORT explicit RecordingPlayer(const std::string& filename);
+
+    static const char* const extension;
+
+    inline size_t frames() const { return index.size(); }
+    /* The simulated time a frame was recorded at, in seconds. */
+    inline double frameTime(size_t frame) const { return index[frame].time; }
+    /* The frame that was last decoded, or frames() before the first one and after one fails. */
+    inline size_t currentFrame() const { return current; }
+
+    /* Decode a frame. Going forwards only decodes the frames in between, unless there's a keyframe on the way to start from.
+     * Anything else starts from the keyframe before it. */
+    EXPORT void seek(size_t frame);
+
+    /* Put the current frame into a universe. Planets shown by the last call are moved instead of being replaced, so their
+     * keys stay valid and whatever is selected or followed stays that way. Anything not in the frame is removed.
+     * Velocities are left at zero, and paths are only kept while playing forwards. */
+    EXPORT void show(PlanetsUniverse& universe);
+
+    inline const RecordingCodec& frame() const { return codec; }
+
+private:
+    struct Frame {
+        size_t offset;
+        size_t size;
+        size_t count;
+        double time;
+        bool keyframe;
+    };
+
+    MappedFile file;
+    std::vector<Frame> index;
+    RecordingCodec codec;
+    size_t current;
+
+    /* Which planet in the universe each recorded planet was shown as, and which frame that was. */
+    std::unordered_map<key_type, key_type> shown;
+    size_t shownFrame;
+    /* Whether seek() went backwards since then. */
+    bool jumped = true;
+
+    void decode(size_t frame);
+};
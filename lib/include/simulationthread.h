@@ -0,0 +1,125 @@
+#pragma once
+
+#include "types.h"
+#include "planetsuniverse.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Advances a copy of a universe on its own thread, so drawing never waits for the simulation and the simulation never waits for drawing.
+ *
+ * The UI keeps its own universe for drawing, picking and placing, and calls sync() once a frame. That sends the settings
+ * and any edits over, and loads the newest snapshot the simulation has published. Snapshots are passed through three buffers,
+ * so neither side ever waits for the other to be done with one. Paths aren't in the snapshots, the UI's universe records
+ * them itself from each snapshot it loads.
+ *
+ * Planets added to or removed from the UI's universe replace the simulation's planets on the next sync(), so every key the UI
+ * hands out stays valid. Anything else can be posted to run on the simulation's universe between steps. The selected and
+ * followed planets are sent over too, and when the simulation merges one of them into another sync() switches to that one. */
+class SimulationThread {
+public:
+    typedef std::function<void(PlanetsUniverse&)> Command;
+
+    EXPORT SimulationThread();
+    EXPORT ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator = (const SimulationThread&) = delete;
+
+    /* Start simulating a copy of the universe, stopping whatever was running before.
+     * Emscripten doesn't have threads, so there sync() advances the simulation itself. */
+    EXPORT void start(const PlanetsUniverse& universe);
+    EXPORT void stop();
+    inline bool isRunning() const { return running; }
+
+    /* Call once a frame from the UI thread. Sends the universe's settings and edits, and loads the newest snapshot into it.
+     * The simulation holds still while advancing is false, like while a planet is being placed. Returns true if a snapshot was loaded. */
+    EXPORT bool sync(PlanetsUniverse& universe, bool advancing = true);
+
+    /* Run a command on the simulation's universe before its next step. Whatever it changes shows up in the next snapshot. */
+    EXPORT void post(const Command& command);
+
+    /* How many times the simulation has been advanced, and how long the last one took in seconds. */
+    inline uint64_t steps() const { return stepCount; }
+    inline float stepTime() const { return lastStepTime; }
+
+    /* The simulated time of the last snapshot sync() loaded, in microseconds since the last start(). */
+    inline double time() const { return syncedTime; }
+
+private:
+    /* Everything in the UI's universe that changes how the simulation runs. */
+    struct Settings {
+        float simspeed;
+        int stepsPerFrame;
+        bool fixedTimestep;
+        float fixedStep;
+        int maxFixedSteps;
+        PlanetsUniverse::ForceBackend forceBackend;
+        float barnesHutTheta;
+        int multipoleOrder;
+        float multipoleTheta;
+        PlanetsUniverse::Integrator integrator;
+        GravityKernel::InstructionSet instructionSet;
+        unsigned int threadCount;
+        bool deterministic;
+        int timestepLevels;
+        float timestepAccuracy;
+        key_type selected;
+        key_type following;
+        bool advancing;
+    };
+
+    struct Buffer {
+        PlanetsUniverse::Snapshot snapshot;
+        /* Which replacement from the UI the planets come from, and the simulated time they're at. */
+        uint64_t generation = 0;
+        double time = 0.0;
+        /* What the simulation's selected and followed planets are now, and which of the UI's keys they started as. */
+        key_type selected = -1, following = -1;
+        key_type selectedFrom = -1, followingFrom = -1;
+    };
+
+    /* Only touched by the simulation thread while it's running. */
+    PlanetsUniverse simulation;
+    uint64_t simulationGeneration = 0;
+    double simulatedTime = 0.0;
+    /* The UI's keys the simulation's selected and followed planets were last set from. */
+    key_type selectedFrom = -1, followingFrom = -1;
+
+    std::thread worker;
+    std::atomic<bool> running;
+
+    /* Guards everything sent from the UI. */
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Command> commands;
+    Settings settings = {};
+    bool quit = false;
+
+    /* The newest buffer is in latest, with fresh set until the UI takes it. The simulation thread owns back and the UI owns front,
+     * and each of them swaps theirs with latest. */
+    static const unsigned int fresh = 4;
+    Buffer buffers[3];
+    std::atomic<unsigned int> latest;
+    unsigned int back = 1;
+    unsigned int front = 2;
+
+    /* Only touched by the UI. */
+    uint64_t generation = 0;
+    uint64_t syncedEdits = 0;
+    double syncedTime = 0.0;
+#ifdef EMSCRIPTEN
+    std::chrono::steady_clock::time_point lastSync;
+#endif
+
+    std::atomic<uint64_t> stepCount;
+    std::atomic<float> lastStepTime;
+
+    /* Run anything sent from the UI, advance by delay microseconds of real time, and publish a snapshot. */
+    void step(int delay);
+    void run();
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.h"
+#include <deque>
+#include <vector>
+
+/* Hands out keys that keep referring to the same item for as long as it exists, while the items themselves
+ * stay packed together at the start of an array. The owner keeps the actual items, and tells the slot map
+ * whenever it moves or gets rid of one so the keys can follow along.
+ *
+ * A key is a slot number in the low bits and a generation in the high bits. The generation goes up every time
+ * a slot is freed, so an old key for a slot that got reused no longer counts as valid. A slot that has used up
+ * every generation is never handed out again, so an old key can't come back to life by wrapping around. */
+class SlotMap {
+public:
+    /* Half of a 64 bit key each, 32 bit keys still leave room for a million planets. */
+    static const key_type slotBits = sizeof(key_type) >= 8 ? 32 : 20;
+    static const key_type slotMask = (key_type(1) << slotBits) - 1;
+
+    /* One slot is left out so -1 can never be a valid key. */
+    static const size_t maxSize = slotMask;
+
+    /* Make a key for a new item at the end of the array. */
+    EXPORT key_type insert();
+
+    inline bool isValid(const key_type& key) const {
+        const key_type slot = key & slotMask;
+        return slot < slots.size() && slots[slot] == key;
+    }
+
+    /* The position of the item in the array, the key has to be valid. */
+    inline size_t index(const key_type& key) const { return indices[key & slotMask]; }
+
+    /* The key of the item at a position in the array. */
+    inline key_type key(size_t index) const { return keys[index]; }
+
+    inline size_t size() const { return keys.size(); }
+
+    /* Free the key of the item at the index. The spot has to be filled by move() or cut off by truncate(). */
+    EXPORT void release(size_t index);
+
+    /* The item at from has been moved to to, replacing whatever was there. */
+    EXPORT void move(size_t from, size_t to);
+
+    /* Cut off everything starting at size, which has to have been moved or released already. */
+    EXPORT void truncate(size_t size);
+
+    EXPORT void clear();
+
+private:
+    /* The current key for every slot, whether or not it's being used. */
+    std::vector<key_type> slots;
+    /* The array index for every slot. */
+    std::vector<size_t> indices;
+    /* The key for every array index. */
+    std::vector<key_type> keys;
+
+    /* Slots get reused in the order they were freed, so any one slot's generation goes up as slowly as possible. */
+    std::deque<key_type> freeSlots;
+};
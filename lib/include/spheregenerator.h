@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
@@ -117,3 +119,63 @@ template <uint32_t slices, uint32_t stacks> Sphere<slices, stacks>::Sphere() {
         }
     }
 }
+
+/* Every level of detail planets get drawn with, from most to least detailed, packed into one vertex buffer and one index buffer.
+ * Each level's triangles start at indexStart[level] in the index buffer, and already point at that level's own vertices.
+ * The last level is a single point at the center, for planets too small to see any detail on. Draw it with GL_POINTS. */
+class SphereLevels {
+public:
+    static const int levels = 5;
+    static const int pointLevel = levels - 1;
+
+    std::vector<Vertex> verts;
+    std::vector<uint32_t> indices;
+    uint32_t indexStart[levels + 1];
+
+    inline uint32_t indexCount(int level) const { return indexStart[level + 1] - indexStart[level]; }
+
+    SphereLevels();
+
+private:
+    template <uint32_t slices, uint32_t stacks> void add(int level);
+};
+
+template <uint32_t slices, uint32_t stacks> void SphereLevels::add(int level) {
+    /* The big ones are too much for the stack. */
+    std::vector<Sphere<slices, stacks>> sphere(1);
+
+    const uint32_t base = uint32_t(verts.size());
+    verts.insert(verts.end(), sphere[0].verts, sphere[0].verts + sphere[0].vertexCount);
+
+    indexStart[level] = uint32_t(indices.size());
+    for (uint32_t i = 0; i < sphere[0].triangleCount; ++i)
+        indices.push_back(base + sphere[0].triangles[i]);
+}
+
+inline SphereLevels::SphereLevels() {
+    add<64, 32>(0);
+    add<32, 16>(1);
+    add<16, 8>(2);
+    add<8, 4>(3);
+
+    /* Lit like any other spot on a sphere, nobody can see the shading on one pixel anyway. */
+    Vertex point = {};
+    point.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+    point.tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+    point.uv = glm::vec2(0.5f);
+
+    indexStart[pointLevel] = uint32_t(indices.size());
+    indices.push_back(uint32_t(verts.size()));
+    verts.push_back(point);
+
+    indexStart[levels] = uint32_t(indices.size());
+}
+
+/* A square from -1 to 1 to draw as a triangle strip, facing +z. Sphere impostors stretch one over each planet
+ * and trace the sphere inside it in the fragment shader, so a planet is the same 4 vertices no matter how close it is. */
+class ImpostorQuad {
+public:
+    static const uint32_t vertexCount = 4;
+
+    glm::vec2 verts[vertexCount] = { glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, -1.0f), glm::vec2(-1.0f, 1.0f), glm::vec2(1.0f, 1.0f) };
+};
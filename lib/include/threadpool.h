@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A set of threads that stay around between calls to run(), so work can be split up every step without starting new threads. */
+class ThreadPool {
+public:
+    /* Called with the index of the task and the index of the thread running it. */
+    typedef std::function<void(size_t, unsigned int)> Job;
+
+    EXPORT ThreadPool();
+    EXPORT ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    /* Set the number of threads, counting the one that calls run(). Emscripten doesn't have threads, so it always uses 1. */
+    EXPORT void resize(unsigned int threads);
+    inline unsigned int size() const { return count; }
+
+    /* Run every task in [0, tasks) and wait for all of them to finish.
+     * Task t always runs on thread t % size(), so anything kept per thread always ends up with the same tasks. */
+    EXPORT void run(size_t tasks, const Job& job);
+
+    /* The number of threads the CPU can run at once. */
+    EXPORT static unsigned int hardwareThreads();
+
+private:
+    std::vector<std::thread> workers;
+    unsigned int count = 1;
+
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+
+    /* The current job, changed only while all the workers are waiting. */
+    const Job* job = nullptr;
+    size_t tasks = 0;
+
+    /* Incremented for every job, so the workers can tell when there's a new one. */
+    unsigned int generation = 0;
+    unsigned int remaining = 0;
+    bool quit = false;
+
+    void work(unsigned int thread, unsigned int seen);
+};
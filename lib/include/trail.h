@@ -0,0 +1,118 @@
+#pragma once
+
+#include "types.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <glm/vec3.hpp>
+
+/* The points a planet has left behind, oldest first, in a ring buffer that holds up to capacity() of them.
+ * Adding a point once the trail is full overwrites the oldest one, so nothing ever has to be moved or allocated
+ * once the buffer has grown to its full size.
+ *
+ * The points aren't contiguous once the ring wraps around, so they're drawn in up to two spans. The first point
+ * is also kept after the end of the buffer, so the first span ends where the second starts and the two line strips join up. */
+class Trail {
+public:
+    /* A run of points that can be drawn as one line strip. */
+    struct Span {
+        const glm::vec3* data;
+        size_t size;
+    };
+
+    inline size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline size_t capacity() const { return length; }
+
+    /* Where the points are stored, spans point into this. Holds dataSize() points, which can be one more than size(). */
+    inline const glm::vec3* data() const { return points.data(); }
+    inline size_t dataSize() const { return points.size(); }
+
+    /* The points in order, 0 being the oldest. */
+    inline const glm::vec3& operator [] (size_t i) const { return points[wrap(first + i)]; }
+    inline const glm::vec3& front() const { return points[first]; }
+    inline const glm::vec3& back() const { return points[wrap(first + count - 1)]; }
+
+    /* Move the newest point. The trail can't be empty. */
+    inline void setBack(const glm::vec3& point) { set(wrap(first + count - 1), point); }
+
+    /* Add a point, dropping the oldest one if the trail is full. */
+    EXPORT void push_back(const glm::vec3& point);
+
+    /* Change how many points the trail keeps, dropping the oldest ones if there are too many. Does nothing if it's the same. */
+    inline void setCapacity(size_t capacity) { if (capacity != length) resize(capacity); }
+
+    /* Remove every point, but keep the memory for the next ones. */
+    inline void clear() { points.clear(); first = 0; count = 0; changedBegin = 0; changedEnd = 0; }
+
+    /* Get the part of data() written since the last call as [begin, end), and start over. It's only tracked once,
+     * so only one thing should keep a copy of the trail up to date with this, like the renderer's vertex buffer. */
+    inline void takeChanges(size_t& begin, size_t& end) {
+        begin = changedBegin;
+        end = changedEnd;
+        changedBegin = 0;
+        changedEnd = 0;
+    }
+
+    inline void swap(Trail& other) {
+        points.swap(other.points);
+        std::swap(first, other.first);
+        std::swap(count, other.count);
+        std::swap(length, other.length);
+        std::swap(changedBegin, other.changedBegin);
+        std::swap(changedEnd, other.changedEnd);
+    }
+
+    /* Fill spans with the points from oldest to newest, returning how many spans were used. (0, 1 or 2) */
+    inline size_t spans(Span* spans) const {
+        if (count == 0)
+            return 0;
+
+        if (first + count <= length) {
+            spans[0] = Span{ points.data() + first, count };
+            return 1;
+        }
+
+        /* The copy of the first point at the end of the buffer is included, so the first span leads into the second. */
+        spans[0] = Span{ points.data() + first, length - first + 1 };
+        spans[1] = Span{ points.data(), first + count - length };
+        return 2;
+    }
+
+private:
+    /* Until the trail fills up there are just count points here, starting at 0. After that there's length + 1,
+     * with the last one always being a copy of the first. */
+    std::vector<glm::vec3> points;
+    /* Where in points the oldest point is. */
+    size_t first = 0;
+    size_t count = 0;
+    size_t length = 0;
+    /* The part of points written since takeChanges(), empty if they're equal. */
+    size_t changedBegin = 0;
+    size_t changedEnd = 0;
+
+    inline size_t wrap(size_t i) const { return i < length ? i : i - length; }
+
+    inline void changed(size_t begin, size_t end) {
+        if (changedBegin == changedEnd) {
+            changedBegin = begin;
+            changedEnd = end;
+        } else {
+            changedBegin = std::min(changedBegin, begin);
+            changedEnd = std::max(changedEnd, end);
+        }
+    }
+
+    /* Write a point, keeping the copy of the first one up to date. */
+    inline void set(size_t i, const glm::vec3& point) {
+        points[i] = point;
+        changed(i, i + 1);
+
+        if (i == 0 && points.size() > length) {
+            points[length] = point;
+            changed(length, length + 1);
+        }
+    }
+
+    EXPORT void resize(size_t capacity);
+};
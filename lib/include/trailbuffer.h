@@ -0,0 +1,44 @@
+#pragma once
+
+#include "types.h"
+#include "planetsuniverse.h"
+#include <vector>
+#include <glm/vec3.hpp>
+
+/* Keeps every planet's trail in one vertex buffer, so only the points that changed since the last frame have to be uploaded,
+ * and every trail can be drawn from it at once. Only works out what to upload and draw, the renderer does the OpenGL calls.
+ *
+ * Each planet's slot in the universe gets its own stride() vertices in the buffer, laid out exactly like the trail's data(). */
+class TrailBuffer {
+public:
+    /* Copy count vertices from data into the buffer starting at vertex offset. */
+    struct Upload {
+        size_t offset;
+        const glm::vec3* data;
+        size_t count;
+    };
+
+    /* What to upload this frame. */
+    std::vector<Upload> uploads;
+
+    /* The first vertex and vertex count of every line strip to draw, ready for glMultiDrawArrays. */
+    std::vector<int> firsts;
+    std::vector<int> counts;
+
+    /* Take the changes out of every trail and fill the lists. Returns true if the buffer has to be reallocated
+     * to size() vertices first, in which case everything gets uploaded. */
+    EXPORT bool update(PlanetsUniverse& universe);
+
+    /* How many vertices the buffer needs. */
+    inline size_t size() const { return stride * uploaded.size(); }
+
+    /* Start over with a new buffer, like after losing the OpenGL context. */
+    inline void reset() { stride = 0; uploaded.clear(); }
+
+private:
+    /* The vertices each slot gets. */
+    size_t stride = 0;
+
+    /* The key of the planet each slot's vertices were last uploaded for. */
+    std::vector<key_type> uploaded;
+};
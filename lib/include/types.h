@@ -4,7 +4,13 @@
 #include <cstddef>
 #include <cstdint>
 
-typedef size_t key_type;
+/* Identifies a planet in a PlanetsUniverse for as long as it exists. (See SlotMap.)
+ * JavaScript numbers can't hold 64 bit integers, so the web version keeps them at 32 bits. */
+#ifdef EMSCRIPTEN
+typedef uint32_t key_type;
+#else
+typedef uint64_t key_type;
+#endif
 
 class Camera;
 class Planet;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "types.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Reads an XML document one tag at a time, without building a tree of the whole thing first. Only understands as much
+ * as universe files need: elements, attributes and the standard entities. Text, comments, CDATA, processing instructions
+ * and doctypes are skipped over. */
+class XmlReader {
+public:
+    enum Event {
+        StartElement,
+        EndElement,
+        EndDocument
+    };
+
+    /* The data has to stay around for as long as the reader is used. */
+    EXPORT XmlReader(const char* data, size_t size);
+
+    /* Move to the next start or end tag. An empty element like <a/> gives a StartElement then an EndElement.
+     * Throws std::runtime_error if the document is malformed, and keeps returning EndDocument once it's over. */
+    EXPORT Event next();
+
+    /* The name of the element the last tag was for. */
+    inline const std::string& name() const { return elementName; }
+
+    /* How many elements are open, counting the one the last tag was for, so the root element is at depth 1. */
+    inline size_t depth() const { return eventDepth; }
+
+    /* The value of an attribute of the last start tag with the entities replaced, or nullptr if it doesn't have it. */
+    EXPORT const std::string* attribute(const char* name) const;
+
+    /* How many bytes have been read so far. */
+    inline size_t position() const { return size_t(cursor - begin); }
+
+private:
+    const char* begin;
+    const char* end;
+    const char* cursor;
+
+    std::string elementName;
+    size_t eventDepth = 0;
+
+    /* Only the first attributeCount are from the last tag, the rest are kept around for their memory. */
+    std::vector<std::pair<std::string, std::string>> attributes;
+    size_t attributeCount = 0;
+
+    /* The names of the elements that are still open, to check the end tags against. */
+    std::vector<std::string> open;
+    /* The end of an empty element still has to be returned. */
+    bool pendingEnd = false;
+
+    /* Throw an error, saying which line it happened on. */
+    [[noreturn]] void fail(const std::string& message) const;
+
+    /* Move past the next instance of a string, or fail if it never comes. */
+    void skipPast(const char* terminator, const char* description);
+    void skipWhitespace();
+    /* Read a tag or attribute name. */
+    void readName(std::string& into);
+    /* Read a quoted attribute value, replacing any entities in it. */
+    void readValue(std::string& into);
+};
@@ -0,0 +1,158 @@
+#ifndef EMSCRIPTEN
+
+#include "backgroundsaver.h"
+#include <cstdio>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* Where a file gets written before it's renamed into place. It keeps its extension, since that picks the format. */
+static std::string temporaryName(const std::string& filename) {
+    const size_t dot = filename.find_last_of('.');
+    const size_t slash = filename.find_last_of("/\\");
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + "~";
+
+    return filename.substr(0, dot) + "~" + filename.substr(dot);
+}
+
+BackgroundSaver::BackgroundSaver() : lastAutosave(std::chrono::steady_clock::now()) { }
+
+BackgroundSaver::~BackgroundSaver() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+}
+
+void BackgroundSaver::save(const PlanetsUniverse& universe, const std::string& filename) {
+    Job job;
+    job.snapshot = std::make_shared<PlanetsUniverse::Snapshot>();
+    universe.saveSnapshot(*job.snapshot, true);
+    job.filename = filename;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+
+        /* Only started once there's something to save. */
+        if (!worker.joinable())
+            worker = std::thread(&BackgroundSaver::run, this);
+    }
+    wake.notify_one();
+}
+
+bool BackgroundSaver::isBusy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writing || !jobs.empty();
+}
+
+void BackgroundSaver::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return !writing && jobs.empty(); });
+}
+
+std::vector<BackgroundSaver::Result> BackgroundSaver::results() {
+    std::vector<Result> taken;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    taken.swap(finished);
+    return taken;
+}
+
+bool BackgroundSaver::autosave(const PlanetsUniverse& universe) {
+    if (autosaveInterval <= 0.0f || autosaveCount < 1)
+        return false;
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<float>(now - lastAutosave).count() < autosaveInterval)
+        return false;
+
+    /* Try again next time instead of piling up saves behind a slow one. */
+    if (universe.isEmpty() || isBusy())
+        return false;
+
+    lastAutosave = now;
+    save(universe, nextAutosave());
+    return true;
+}
+
+std::string BackgroundSaver::nextAutosave() const {
+    std::string oldest;
+    time_t oldestTime = 0;
+
+    for (int i = 1; i <= autosaveCount; ++i) {
+        const std::string filename = autosavePrefix + "-" + std::to_string(i) + PlanetsUniverse::binaryExtension;
+
+        struct stat info;
+        if (stat(filename.c_str(), &info) != 0)
+            return filename;
+
+        if (oldest.empty() || info.st_mtime < oldestTime) {
+            oldest = filename;
+            oldestTime = info.st_mtime;
+        }
+    }
+
+    return oldest;
+}
+
+void BackgroundSaver::run() {
+    /* Saving goes through a universe, kept around so its memory gets reused. */
+    PlanetsUniverse writer;
+
+    for (;;) {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            writing = false;
+            if (jobs.empty())
+                idle.notify_all();
+
+            /* Anything still waiting gets saved before quitting. */
+            wake.wait(lock, [this] { return quit || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+
+            job = jobs.front();
+            jobs.pop_front();
+            writing = true;
+        }
+
+        Result result;
+        result.filename = job.filename;
+
+        try {
+            writer.loadSnapshot(*job.snapshot);
+            job.snapshot.reset();
+
+            const std::string temporary = temporaryName(job.filename);
+            writer.save(temporary);
+
+#ifdef _WIN32
+            /* rename() won't replace a file that's already there, and removing it first would leave nothing if something
+             * happened in between. This replaces it in one go. */
+            if (!MoveFileExA(temporary.c_str(), job.filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+#else
+            if (std::rename(temporary.c_str(), job.filename.c_str()) != 0)
+#endif
+                throw std::runtime_error("Unable to move \"" + temporary + "\" to \"" + job.filename + "\"!");
+        } catch (const std::exception& error) {
+            result.error = error.what();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(result);
+    }
+}
+
+#endif
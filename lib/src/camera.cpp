@@ -41,15 +41,15 @@ const glm::mat4& Camera::setup() {
         switch (followingState) {
         case Single:
             if (universe.isValid(universe.following))
-                position = universe[universe.following].position;
+                position = universe.interpolatedPosition(universe.following);
             else
                 /* If the following target is invalid, reset following state. */
                 followingState = FollowNone;
             break;
         case PlainAverage:
             position = glm::vec3();
-            for (const auto& i : universe)
-                position += i.position;
+            for (auto i = universe.cbegin(); i != universe.cend(); ++i)
+                position += universe.interpolatedPosition(i.key());
 
             position /= universe.size();
             break;
@@ -57,9 +57,9 @@ const glm::mat4& Camera::setup() {
             position = glm::vec3();
             float totalMass = 0.0f;
 
-            for (const auto& i : universe) {
-                position += i.position * i.mass();
-                totalMass += i.mass();
+            for (auto i = universe.cbegin(); i != universe.cend(); ++i) {
+                position += universe.interpolatedPosition(i.key()) * i->mass();
+                totalMass += i->mass();
             }
             position /= totalMass;
             break;
@@ -110,9 +110,9 @@ key_type Camera::selectUnder(const glm::ivec2& pos, float scale) {
     Ray ray = getRay(pos);
 
     /* Go through each planet and see if the ray intersects it. */
-    for (int i = 0; i < universe.size(); ++i) {
+    for (auto i = universe.cbegin(); i != universe.cend(); ++i) {
         /* Find the directional vector from the ray origin to the planet. */
-        glm::vec3 difference = universe[i].position - ray.origin;
+        glm::vec3 difference = i->position - ray.origin;
 
         float dot = glm::dot(difference, ray.direction);
 
@@ -121,8 +121,8 @@ key_type Camera::selectUnder(const glm::ivec2& pos, float scale) {
 
         /* distance^2 - dot^2 is the closest the ray gets to the planet's center point.
          * Comparing to the planet radius tells whether or not it intersects. */
-        if (distance < nearest && (distance - dot * dot) <= (universe[i].radius() * universe[i].radius() * scale)) {
-            universe.selected = i;
+        if (distance < nearest && (distance - dot * dot) <= (i->radius() * i->radius() * scale)) {
+            universe.selected = i.key();
             nearest = distance;
         }
     }
@@ -136,15 +136,24 @@ void Camera::clearFollow() {
 }
 
 void Camera::followNext() {
-    if (universe.isValid(++universe.following) || universe.isValid(universe.following = 0))
+    if (!universe.isEmpty()) {
+        /* Go to the next planet in the order they're stored, wrapping around at the end. */
+        size_t index = universe.isValid(universe.following) ? universe.indexOf(universe.following) + 1 : 0;
+        universe.following = universe.keyAt(index < universe.size() ? index : 0);
+
         /* This may already be set, but set it anyway in case it isn't. */
         followingState = Single;
+    }
 }
 
 void Camera::followPrevious() {
-    if (universe.isValid(--universe.following) || universe.isValid(universe.following = universe.size() - 1))
+    if (!universe.isEmpty()) {
+        size_t index = universe.isValid(universe.following) ? universe.indexOf(universe.following) : 0;
+        universe.following = universe.keyAt(index > 0 ? index - 1 : universe.size() - 1);
+
         /* This may already be set, but set it anyway in case it isn't. */
         followingState = Single;
+    }
 }
 
 void Camera::followSelection() {
@@ -158,3 +167,14 @@ glm::ivec2 Camera::getCenterScreen() const {
     /* Use the viewport values to calculate pixel coordinate of the center of the screen. */
     return glm::ivec2(viewport.z / 2, viewport.w / 2);
 }
+
+glm::vec3 Camera::getEye() const {
+    /* The view matrix only rotates and moves, so undoing the rotation is multiplying by its transpose. */
+    const glm::vec3 offset(view[3]);
+    return -glm::vec3(glm::dot(glm::vec3(view[0]), offset), glm::dot(glm::vec3(view[1]), offset), glm::dot(glm::vec3(view[2]), offset));
+}
+
+glm::vec3 Camera::getUp() const {
+    /* The second row of the rotation is the screen's y axis. */
+    return glm::vec3(view[0][1], view[1][1], view[2][1]);
+}
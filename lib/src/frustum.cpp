@@ -0,0 +1,58 @@
+#include "frustum.h"
+#include <glm/geometric.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PLANETS3D_SSE
+#include <xmmintrin.h>
+#endif
+
+Frustum::Frustum(const glm::mat4& camera) {
+    /* Each plane is where a clip coordinate meets w, so it comes from adding or subtracting the rows of the matrix. */
+    const glm::vec4 x(camera[0][0], camera[1][0], camera[2][0], camera[3][0]);
+    const glm::vec4 y(camera[0][1], camera[1][1], camera[2][1], camera[3][1]);
+    const glm::vec4 z(camera[0][2], camera[1][2], camera[2][2], camera[3][2]);
+    const glm::vec4 w(camera[0][3], camera[1][3], camera[2][3], camera[3][3]);
+
+    planes[0] = w + x;
+    planes[1] = w - x;
+    planes[2] = w + y;
+    planes[3] = w - y;
+    planes[4] = w + z;
+    planes[5] = w - z;
+
+    for (glm::vec4& plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+void Frustum::cull(const glm::vec3* centers, const float* radii, size_t begin, size_t end, float scale, std::vector<uint32_t>& visible) const {
+#ifdef PLANETS3D_SSE
+    /* Each register holds one part of four planes, the second set has the near and far planes twice. */
+    const __m128 ax = _mm_setr_ps(planes[0].x, planes[1].x, planes[2].x, planes[3].x);
+    const __m128 ay = _mm_setr_ps(planes[0].y, planes[1].y, planes[2].y, planes[3].y);
+    const __m128 az = _mm_setr_ps(planes[0].z, planes[1].z, planes[2].z, planes[3].z);
+    const __m128 aw = _mm_setr_ps(planes[0].w, planes[1].w, planes[2].w, planes[3].w);
+    const __m128 bx = _mm_setr_ps(planes[4].x, planes[5].x, planes[4].x, planes[5].x);
+    const __m128 by = _mm_setr_ps(planes[4].y, planes[5].y, planes[4].y, planes[5].y);
+    const __m128 bz = _mm_setr_ps(planes[4].z, planes[5].z, planes[4].z, planes[5].z);
+    const __m128 bw = _mm_setr_ps(planes[4].w, planes[5].w, planes[4].w, planes[5].w);
+    const __m128 negate = _mm_set1_ps(-scale);
+
+    for (size_t i = begin; i < end; ++i) {
+        const __m128 x = _mm_set1_ps(centers[i].x);
+        const __m128 y = _mm_set1_ps(centers[i].y);
+        const __m128 z = _mm_set1_ps(centers[i].z);
+        const __m128 r = _mm_mul_ps(_mm_set1_ps(radii[i]), negate);
+
+        const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, x), _mm_mul_ps(ay, y)), _mm_add_ps(_mm_mul_ps(az, z), aw));
+        const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, x), _mm_mul_ps(by, y)), _mm_add_ps(_mm_mul_ps(bz, z), bw));
+
+        /* Outside if it's further than its radius behind any plane. */
+        if (_mm_movemask_ps(_mm_or_ps(_mm_cmplt_ps(a, r), _mm_cmplt_ps(b, r))) == 0)
+            visible.push_back(uint32_t(i));
+    }
+#else
+    for (size_t i = begin; i < end; ++i)
+        if (intersects(centers[i], radii[i] * scale))
+            visible.push_back(uint32_t(i));
+#endif
+}
@@ -0,0 +1,312 @@
+#include "gravitykernel.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PLANETS3D_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+/* MSVC lets any function use any intrinsic. */
+#define TARGET(isa)
+#else
+/* GCC and Clang need to be told which functions can use which instructions, so the rest of the library still runs anywhere. */
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+/* The arrays are padded to a multiple of the widest vector. */
+static const size_t padding = 16;
+
+/* Padding bodies have no mass and sit far enough away that they never touch anything,
+ * but not so far that the math on them overflows or turns into slow denormals. */
+static const float paddingPosition = 1.0e10f;
+
+GravityKernel::InstructionSet GravityKernel::detect() {
+#if defined(PLANETS3D_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+
+    bool avx2 = false, avx512 = false;
+
+    if (maxLeaf >= 7 && osxsave) {
+        /* The OS has to save the larger registers when switching threads, or they can't be used. */
+        const unsigned long long xcr0 = _xgetbv(0);
+
+        __cpuidex(info, 7, 0);
+        avx2 = fma && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+    }
+
+    return avx512 ? AVX512 : avx2 ? AVX2 : SSE;
+#elif defined(PLANETS3D_X86)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SSE;
+
+    return Scalar;
+#else
+    return Scalar;
+#endif
+}
+
+const char* GravityKernel::name(InstructionSet set) {
+    switch (set) {
+    case SSE:
+        return "SSE";
+    case AVX2:
+        return "AVX2";
+    case AVX512:
+        return "AVX-512";
+    default:
+        return "Scalar";
+    }
+}
+
+void GravityKernel::load(const glm::vec3* positions, const float* masses, const float* radii, size_t count) {
+    this->count = count;
+
+    const size_t padded = (count + padding - 1) / padding * padding;
+
+    x.resize(padded);
+    y.resize(padded);
+    z.resize(padded);
+    mass.resize(padded);
+    radius.resize(padded);
+
+    for (size_t i = 0; i < count; ++i) {
+        x[i] = positions[i].x;
+        y[i] = positions[i].y;
+        z[i] = positions[i].z;
+        mass[i] = masses[i];
+        radius[i] = radii[i];
+    }
+
+    for (size_t i = count; i < padded; ++i) {
+        x[i] = y[i] = z[i] = paddingPosition;
+        mass[i] = radius[i] = 0.0f;
+    }
+}
+
+void GravityKernel::finish() {
+    const size_t padded = (count + padding - 1) / padding * padding;
+
+    x.resize(padded, paddingPosition);
+    y.resize(padded, paddingPosition);
+    z.resize(padded, paddingPosition);
+    mass.resize(padded, 0.0f);
+    radius.resize(padded, 0.0f);
+}
+
+/* Every version works the same way: each body in the list is compared against every loaded body, including itself.
+ * A pair only pulls on each other if it is further apart than the sum of the radii, which also skips the body itself.
+ * The encounter strength is the largest (mass + other mass) / distance^3 out of those pairs. */
+
+static void accumulateScalar(const float* x, const float* y, const float* z, const float* mass, const float* radius, size_t loaded,
+                             const uint32_t* bodies, size_t count, glm::vec3* accelerations, float* encounters) {
+    for (size_t k = 0; k < count; ++k) {
+        const size_t i = bodies[k];
+        glm::vec3 result;
+        float encounter = 0.0f;
+
+        for (size_t j = 0; j < loaded; ++j) {
+            const glm::vec3 direction(x[j] - x[i], y[j] - y[i], z[j] - z[i]);
+            const float distance2 = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+            const float reach = radius[i] + radius[j];
+
+            if (distance2 > reach * reach) {
+                const float inverse3 = 1.0f / (distance2 * std::sqrt(distance2));
+                result += direction * (mass[j] * inverse3);
+                encounter = std::max(encounter, (mass[i] + mass[j]) * inverse3);
+            }
+        }
+
+        accelerations[k] = result;
+        if (encounters != nullptr)
+            encounters[k] = encounter;
+    }
+}
+
+#ifdef PLANETS3D_X86
+
+TARGET("sse2")
+static inline float sum(__m128 v) {
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+TARGET("sse2")
+static inline float maximum(__m128 v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+TARGET("sse2")
+static void accumulateSSE(const float* x, const float* y, const float* z, const float* mass, const float* radius, size_t padded,
+                          const uint32_t* bodies, size_t count, glm::vec3* accelerations, float* encounters) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 threeHalves = _mm_set1_ps(1.5f);
+
+    for (size_t k = 0; k < count; ++k) {
+        const size_t i = bodies[k];
+        const __m128 xi = _mm_set1_ps(x[i]), yi = _mm_set1_ps(y[i]), zi = _mm_set1_ps(z[i]), ri = _mm_set1_ps(radius[i]), mi = _mm_set1_ps(mass[i]);
+        __m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps(), az = _mm_setzero_ps(), encounter = _mm_setzero_ps();
+
+        for (size_t j = 0; j < padded; j += 4) {
+            const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + j), xi);
+            const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + j), yi);
+            const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + j), zi);
+            const __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+            __m128 reach = _mm_add_ps(ri, _mm_loadu_ps(radius + j));
+            reach = _mm_mul_ps(reach, reach);
+
+            const __m128 apart = _mm_cmpgt_ps(distance2, reach);
+
+            /* The hardware estimate is only good to 12 bits, one Newton-Raphson step brings it close to full precision. */
+            __m128 inverse = _mm_rsqrt_ps(distance2);
+            inverse = _mm_mul_ps(inverse, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, distance2), _mm_mul_ps(inverse, inverse))));
+
+            const __m128 inverse3 = _mm_and_ps(apart, _mm_mul_ps(inverse, _mm_mul_ps(inverse, inverse)));
+            const __m128 massj = _mm_loadu_ps(mass + j);
+            const __m128 force = _mm_mul_ps(massj, inverse3);
+
+            ax = _mm_add_ps(ax, _mm_mul_ps(force, dx));
+            ay = _mm_add_ps(ay, _mm_mul_ps(force, dy));
+            az = _mm_add_ps(az, _mm_mul_ps(force, dz));
+            encounter = _mm_max_ps(encounter, _mm_mul_ps(_mm_add_ps(mi, massj), inverse3));
+        }
+
+        accelerations[k] = glm::vec3(sum(ax), sum(ay), sum(az));
+        if (encounters != nullptr)
+            encounters[k] = maximum(encounter);
+    }
+}
+
+TARGET("avx2,fma")
+static inline float sum(__m256 v) {
+    return sum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+TARGET("avx2,fma")
+static inline float maximum(__m256 v) {
+    return maximum(_mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+}
+
+TARGET("avx2,fma")
+static void accumulateAVX2(const float* x, const float* y, const float* z, const float* mass, const float* radius, size_t padded,
+                           const uint32_t* bodies, size_t count, glm::vec3* accelerations, float* encounters) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+
+    for (size_t k = 0; k < count; ++k) {
+        const size_t i = bodies[k];
+        const __m256 xi = _mm256_set1_ps(x[i]), yi = _mm256_set1_ps(y[i]), zi = _mm256_set1_ps(z[i]), ri = _mm256_set1_ps(radius[i]), mi = _mm256_set1_ps(mass[i]);
+        __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps(), encounter = _mm256_setzero_ps();
+
+        for (size_t j = 0; j < padded; j += 8) {
+            const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+            const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+            const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), zi);
+            const __m256 distance2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+
+            __m256 reach = _mm256_add_ps(ri, _mm256_loadu_ps(radius + j));
+            reach = _mm256_mul_ps(reach, reach);
+
+            const __m256 apart = _mm256_cmp_ps(distance2, reach, _CMP_GT_OQ);
+
+            __m256 inverse = _mm256_rsqrt_ps(distance2);
+            inverse = _mm256_mul_ps(inverse, _mm256_fnmadd_ps(_mm256_mul_ps(half, distance2), _mm256_mul_ps(inverse, inverse), threeHalves));
+
+            const __m256 inverse3 = _mm256_and_ps(apart, _mm256_mul_ps(inverse, _mm256_mul_ps(inverse, inverse)));
+            const __m256 massj = _mm256_loadu_ps(mass + j);
+            const __m256 force = _mm256_mul_ps(massj, inverse3);
+
+            ax = _mm256_fmadd_ps(force, dx, ax);
+            ay = _mm256_fmadd_ps(force, dy, ay);
+            az = _mm256_fmadd_ps(force, dz, az);
+            encounter = _mm256_max_ps(encounter, _mm256_fmadd_ps(mi, inverse3, force));
+        }
+
+        accelerations[k] = glm::vec3(sum(ax), sum(ay), sum(az));
+        if (encounters != nullptr)
+            encounters[k] = maximum(encounter);
+    }
+}
+
+TARGET("avx512f")
+static void accumulateAVX512(const float* x, const float* y, const float* z, const float* mass, const float* radius, size_t padded,
+                             const uint32_t* bodies, size_t count, glm::vec3* accelerations, float* encounters) {
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 threeHalves = _mm512_set1_ps(1.5f);
+
+    for (size_t k = 0; k < count; ++k) {
+        const size_t i = bodies[k];
+        const __m512 xi = _mm512_set1_ps(x[i]), yi = _mm512_set1_ps(y[i]), zi = _mm512_set1_ps(z[i]), ri = _mm512_set1_ps(radius[i]), mi = _mm512_set1_ps(mass[i]);
+        __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps(), az = _mm512_setzero_ps(), encounter = _mm512_setzero_ps();
+
+        for (size_t j = 0; j < padded; j += 16) {
+            const __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), xi);
+            const __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), yi);
+            const __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), zi);
+            const __m512 distance2 = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+
+            __m512 reach = _mm512_add_ps(ri, _mm512_loadu_ps(radius + j));
+            reach = _mm512_mul_ps(reach, reach);
+
+            const __mmask16 apart = _mm512_cmp_ps_mask(distance2, reach, _CMP_GT_OQ);
+
+            /* This estimate is good to 14 bits, so the Newton-Raphson step gets it right to the last bit or so. */
+            __m512 inverse = _mm512_rsqrt14_ps(distance2);
+            inverse = _mm512_mul_ps(inverse, _mm512_fnmadd_ps(_mm512_mul_ps(half, distance2), _mm512_mul_ps(inverse, inverse), threeHalves));
+
+            const __m512 inverse3 = _mm512_maskz_mul_ps(apart, inverse, _mm512_mul_ps(inverse, inverse));
+            const __m512 force = _mm512_mul_ps(_mm512_loadu_ps(mass + j), inverse3);
+
+            ax = _mm512_fmadd_ps(force, dx, ax);
+            ay = _mm512_fmadd_ps(force, dy, ay);
+            az = _mm512_fmadd_ps(force, dz, az);
+            encounter = _mm512_max_ps(encounter, _mm512_fmadd_ps(mi, inverse3, force));
+        }
+
+        accelerations[k] = glm::vec3(_mm512_reduce_add_ps(ax), _mm512_reduce_add_ps(ay), _mm512_reduce_add_ps(az));
+        if (encounters != nullptr)
+            encounters[k] = _mm512_reduce_max_ps(encounter);
+    }
+}
+
+#endif
+
+void GravityKernel::accumulate(InstructionSet set, const uint32_t* bodies, size_t count, glm::vec3* accelerations, float* encounters) const {
+    const size_t padded = x.size();
+
+    switch (set) {
+#ifdef PLANETS3D_X86
+    case AVX512:
+        accumulateAVX512(x.data(), y.data(), z.data(), mass.data(), radius.data(), padded, bodies, count, accelerations, encounters);
+        break;
+    case AVX2:
+        accumulateAVX2(x.data(), y.data(), z.data(), mass.data(), radius.data(), padded, bodies, count, accelerations, encounters);
+        break;
+    case SSE:
+        accumulateSSE(x.data(), y.data(), z.data(), mass.data(), radius.data(), padded, bodies, count, accelerations, encounters);
+        break;
+#endif
+    default:
+        accumulateScalar(x.data(), y.data(), z.data(), mass.data(), radius.data(), this->count, bodies, count, accelerations, encounters);
+        break;
+    }
+}
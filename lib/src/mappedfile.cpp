@@ -0,0 +1,72 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename) {
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        return;
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+        return;
+
+    data_p = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data_p != nullptr)
+        size_p = size_t(fileSize.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+    if (data_p != nullptr)
+        UnmapViewOfFile(data_p);
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    if (file != nullptr)
+        CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+    const int file = open(filename.c_str(), O_RDONLY);
+    if (file < 0)
+        return;
+
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+        void* mapped = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+        if (mapped != MAP_FAILED) {
+            /* Everything gets read once from start to end. */
+            posix_madvise(mapped, size_t(status.st_size), POSIX_MADV_SEQUENTIAL);
+
+            data_p = static_cast<const char*>(mapped);
+            size_p = size_t(status.st_size);
+        }
+    }
+
+    /* The mapping keeps the file around by itself. */
+    close(file);
+}
+
+MappedFile::~MappedFile() {
+    if (data_p != nullptr)
+        munmap(const_cast<char*>(data_p), size_p);
+}
+
+#endif
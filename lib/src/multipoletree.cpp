@@ -0,0 +1,350 @@
+#include "multipoletree.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+/* std::min takes it by reference, so it needs to exist somewhere. */
+const int MultipoleTree::maxOrder;
+
+/* The number of terms in an expansion of the highest order. */
+static const size_t maxTerms = (MultipoleTree::maxOrder + 1) * (MultipoleTree::maxOrder + 2) * (MultipoleTree::maxOrder + 3) / 6;
+
+/* How many leaves to give a thread at once. */
+static const size_t chunkSize = 16;
+
+void MultipoleTree::setOrder(int order) {
+    if (order == this->order)
+        return;
+
+    this->order = order;
+
+    /* Number every term, lowest order first, so a term only ever depends on the ones before it. */
+    int index[maxOrder + 1][maxOrder + 1][maxOrder + 1];
+    terms.clear();
+
+    for (int n = 0; n <= order; ++n)
+        for (int x = n; x >= 0; --x)
+            for (int y = n - x; y >= 0; --y) {
+                const int z = n - x - y;
+                index[x][y][z] = int(terms.size());
+                terms.push_back(Term{ uint8_t(x), uint8_t(y), uint8_t(z), uint8_t(n) });
+            }
+
+    /* The term with one less power on an axis. */
+    auto lower = [&index](const Term& term, int axis, int by) {
+        return uint32_t(index[term.x - (axis == 0) * by][term.y - (axis == 1) * by][term.z - (axis == 2) * by]);
+    };
+
+    powerSteps.clear();
+    derivativeSteps.clear();
+    derivativeStart.assign(1, 0);
+    derivativeStart.push_back(0);
+
+    for (size_t t = 1; t < terms.size(); ++t) {
+        const Term& term = terms[t];
+        const int powers[3] = { term.x, term.y, term.z };
+        const int n = term.order;
+
+        /* d^t / t! = d^(t - e_i) / (t - e_i)! * d_i / t_i, using whichever axis has a power. */
+        const int axis = term.x > 0 ? 0 : term.y > 0 ? 1 : 2;
+        powerSteps.push_back(Step{ lower(term, axis, 1), uint32_t(axis), 1.0 / powers[axis] });
+
+        /* The derivatives of 1 / |r| follow the recurrence
+         * |n| r^2 D(n) = -(2|n| - 1) sum(n_i r_i D(n - e_i)) - (|n| - 1) sum(n_i (n_i - 1) D(n - 2 e_i))
+         * The r^2 and minus sign get applied afterwards. */
+        for (int i = 0; i < 3; ++i) {
+            if (powers[i] >= 1)
+                derivativeSteps.push_back(Step{ lower(term, i, 1), uint32_t(i), double((2 * n - 1) * powers[i]) / n });
+            if (powers[i] >= 2)
+                derivativeSteps.push_back(Step{ lower(term, i, 2), 3, double((n - 1) * powers[i] * (powers[i] - 1)) / n });
+        }
+
+        derivativeStart.push_back(uint32_t(derivativeSteps.size()));
+    }
+
+    products.clear();
+    productStart.clear();
+
+    for (size_t b = 0; b < terms.size(); ++b) {
+        productStart.push_back(uint32_t(products.size()));
+
+        for (size_t a = 0; a < terms.size() && terms[a].order + terms[b].order <= order; ++a)
+            products.push_back(Product{ uint32_t(index[terms[a].x + terms[b].x][terms[a].y + terms[b].y][terms[a].z + terms[b].z]),
+                                        uint32_t(a), uint32_t(b) });
+    }
+
+    productStart.push_back(uint32_t(products.size()));
+
+    for (int axis = 0; axis < 3; ++axis) {
+        raise[axis].clear();
+
+        for (size_t t = 0; t < terms.size(); ++t) {
+            const Term& term = terms[t];
+            if (term.order < order)
+                raise[axis].push_back(std::make_pair(uint32_t(t), uint32_t(index[term.x + (axis == 0)][term.y + (axis == 1)][term.z + (axis == 2)])));
+        }
+    }
+}
+
+void MultipoleTree::powers(const glm::dvec3& d, double* result) const {
+    const double components[3] = { d.x, d.y, d.z };
+    result[0] = 1.0;
+
+    for (size_t t = 1; t < terms.size(); ++t) {
+        const Step& step = powerSteps[t - 1];
+        result[t] = result[step.source] * components[step.axis] * step.factor;
+    }
+}
+
+void MultipoleTree::derivatives(const glm::dvec3& r, double* result) const {
+    const double components[4] = { r.x, r.y, r.z, 1.0 };
+    const double inverse2 = 1.0 / glm::dot(r, r);
+    result[0] = std::sqrt(inverse2);
+
+    for (size_t t = 1; t < terms.size(); ++t) {
+        double sum = 0.0;
+
+        for (uint32_t s = derivativeStart[t]; s < derivativeStart[t + 1]; ++s) {
+            const Step& step = derivativeSteps[s];
+            sum += step.factor * components[step.axis] * result[step.source];
+        }
+
+        result[t] = -sum * inverse2;
+    }
+}
+
+void MultipoleTree::findInteractions(float theta) {
+    approximated.clear();
+    direct.clear();
+
+    stack.clear();
+    stack.push_back(std::make_pair(0u, 0u));
+
+    while (!stack.empty()) {
+        const uint32_t a = stack.back().first, b = stack.back().second;
+        stack.pop_back();
+
+        const Octree::Node& nodeA = tree.nodes[a];
+        const Octree::Node& nodeB = tree.nodes[b];
+
+        /* A node against itself always has to be split up, into every pair of its children. */
+        if (a == b) {
+            if (nodeA.childCount == 0)
+                direct.push_back(std::make_pair(a, b));
+            else
+                for (uint32_t c = nodeA.firstChild; c < nodeA.firstChild + nodeA.childCount; ++c)
+                    for (uint32_t o = nodeA.firstChild; o < nodeA.firstChild + nodeA.childCount; ++o)
+                        stack.push_back(std::make_pair(c, o));
+            continue;
+        }
+
+        const float distance = glm::distance(nodeA.centerOfMass, nodeB.centerOfMass);
+
+        if (nodeRadius[a] + nodeRadius[b] < theta * distance) {
+            approximated.push_back(std::make_pair(a, b));
+        } else if (nodeA.childCount == 0 && nodeB.childCount == 0) {
+            direct.push_back(std::make_pair(a, b));
+        } else if (nodeB.childCount == 0 || (nodeA.childCount != 0 && nodeRadius[a] >= nodeRadius[b])) {
+            /* Split whichever node is bigger. */
+            for (uint32_t c = nodeA.firstChild; c < nodeA.firstChild + nodeA.childCount; ++c)
+                stack.push_back(std::make_pair(c, b));
+        } else {
+            for (uint32_t c = nodeB.firstChild; c < nodeB.firstChild + nodeB.childCount; ++c)
+                stack.push_back(std::make_pair(a, c));
+        }
+    }
+}
+
+void MultipoleTree::sortByTarget(std::vector<std::pair<uint32_t, uint32_t>>& pairs, std::vector<uint32_t>& start, size_t nodes) {
+    /* A counting sort, since there are only so many nodes. */
+    start.assign(nodes + 1, 0);
+    for (const auto& pair : pairs)
+        ++start[pair.first + 1];
+
+    for (size_t n = 0; n < nodes; ++n)
+        start[n + 1] += start[n];
+
+    std::vector<std::pair<uint32_t, uint32_t>> sorted(pairs.size());
+    std::vector<uint32_t> next(start.begin(), start.end() - 1);
+
+    for (const auto& pair : pairs)
+        sorted[next[pair.first]++] = pair;
+
+    pairs.swap(sorted);
+}
+
+void MultipoleTree::solve(const glm::vec3* positions, const float* masses, const float* radii, size_t count,
+                          int order, float theta, GravityKernel::InstructionSet set, ThreadPool& pool, glm::vec3* accelerations) {
+    setOrder(std::max(1, std::min(order, maxOrder)));
+
+    if (count == 0)
+        return;
+
+    const size_t termCount = terms.size();
+
+    tree.leafSize = leafSize;
+    tree.bodies.resize(count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        Octree::Body& body = tree.bodies[i];
+        body.position = positions[i];
+        body.mass = masses[i];
+        body.radius = radii[i];
+        body.index = i;
+    }
+
+    tree.build();
+
+    const size_t nodeCount = tree.nodes.size();
+
+    multipoles.assign(nodeCount * termCount, 0.0);
+    locals.assign(nodeCount * termCount, 0.0);
+    nodeRadius.assign(nodeCount, 0.0f);
+
+    leaves.clear();
+    for (uint32_t n = 0; n < nodeCount; ++n)
+        if (tree.nodes[n].childCount == 0)
+            leaves.push_back(n);
+
+    /* Turn the bodies in each leaf into an expansion around the leaf's center of mass. */
+    pool.run((leaves.size() + chunkSize - 1) / chunkSize, [this, termCount](size_t task, unsigned int) {
+        double power[maxTerms];
+
+        for (size_t l = task * chunkSize; l < std::min((task + 1) * chunkSize, leaves.size()); ++l) {
+            const Octree::Node& node = tree.nodes[leaves[l]];
+            const glm::dvec3 center(node.centerOfMass);
+            double* multipole = &multipoles[leaves[l] * termCount];
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                const Octree::Body& body = tree.bodies[i];
+                powers(center - glm::dvec3(body.position), power);
+
+                for (size_t t = 0; t < termCount; ++t)
+                    multipole[t] += body.mass * power[t];
+            }
+        }
+    });
+
+    /* Going through every body in every node only costs as much as the tree is deep, and gets a much tighter size than going by the children. */
+    pool.run((nodeCount + chunkSize - 1) / chunkSize, [this, nodeCount](size_t task, unsigned int) {
+        for (size_t n = task * chunkSize; n < std::min((task + 1) * chunkSize, nodeCount); ++n) {
+            const Octree::Node& node = tree.nodes[n];
+
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                nodeRadius[n] = std::max(nodeRadius[n], glm::distance(node.centerOfMass, tree.bodies[i].position) + tree.bodies[i].radius);
+        }
+    });
+
+    /* Children always come after their parents, so going backwards combines every node's children before the node itself is needed. */
+    double power[maxTerms];
+
+    for (size_t n = nodeCount; n-- > 0;) {
+        const Octree::Node& node = tree.nodes[n];
+        double* multipole = &multipoles[n * termCount];
+
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+            const glm::dvec3 offset = glm::dvec3(node.centerOfMass) - glm::dvec3(tree.nodes[c].centerOfMass);
+            const double* child = &multipoles[c * termCount];
+            powers(offset, power);
+
+            for (const Product& product : products)
+                multipole[product.sum] += power[product.a] * child[product.b];
+        }
+    }
+
+    findInteractions(theta);
+    sortByTarget(approximated, approximatedStart, nodeCount);
+    sortByTarget(direct, directStart, nodeCount);
+
+    /* Turn every far away node's expansion into a local expansion around each node feeling it.
+     * Each node only writes to its own local expansion, so the nodes can be split between threads. */
+    pool.run((nodeCount + chunkSize - 1) / chunkSize, [this, termCount, nodeCount](size_t task, unsigned int) {
+        double derivative[maxTerms];
+
+        for (size_t n = task * chunkSize; n < std::min((task + 1) * chunkSize, nodeCount); ++n) {
+            double* local = &locals[n * termCount];
+
+            for (uint32_t p = approximatedStart[n]; p < approximatedStart[n + 1]; ++p) {
+                const uint32_t source = approximated[p].second;
+                const double* multipole = &multipoles[source * termCount];
+                derivatives(glm::dvec3(tree.nodes[n].centerOfMass) - glm::dvec3(tree.nodes[source].centerOfMass), derivative);
+
+                for (size_t t = 0; t < termCount; ++t) {
+                    double sum = 0.0;
+                    for (uint32_t p = productStart[t]; p < productStart[t + 1]; ++p)
+                        sum += multipole[products[p].a] * derivative[products[p].sum];
+
+                    local[t] += sum;
+                }
+            }
+        }
+    });
+
+    /* Parents always come first, so going forwards passes each node's local expansion down before its children need it. */
+    for (size_t n = 0; n < nodeCount; ++n) {
+        const Octree::Node& node = tree.nodes[n];
+        const double* local = &locals[n * termCount];
+
+        for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c) {
+            double* child = &locals[c * termCount];
+            powers(glm::dvec3(tree.nodes[c].centerOfMass) - glm::dvec3(node.centerOfMass), power);
+
+            for (size_t t = 0; t < termCount; ++t) {
+                double sum = 0.0;
+                for (uint32_t p = productStart[t]; p < productStart[t + 1]; ++p)
+                    sum += local[products[p].sum] * power[products[p].a];
+
+                child[t] += sum;
+            }
+        }
+    }
+
+    /* Every body gets the gradient of its leaf's local expansion, plus every body in the nearby leaves one at a time.
+     * The leaf's own bodies go into the kernel first, so they're the first ones in it. */
+    nearby.resize(pool.size());
+
+    pool.run((leaves.size() + chunkSize - 1) / chunkSize, [this, termCount, set, accelerations](size_t task, unsigned int thread) {
+        Nearby& near = nearby[thread];
+        double power[maxTerms];
+
+        for (size_t l = task * chunkSize; l < std::min((task + 1) * chunkSize, leaves.size()); ++l) {
+            const uint32_t leaf = leaves[l];
+            const Octree::Node& node = tree.nodes[leaf];
+            const double* local = &locals[leaf * termCount];
+
+            near.kernel.clear();
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                near.kernel.add(tree.bodies[i].position, tree.bodies[i].mass, tree.bodies[i].radius);
+
+            for (uint32_t p = directStart[leaf]; p < directStart[leaf + 1]; ++p) {
+                const Octree::Node& source = tree.nodes[direct[p].second];
+                if (direct[p].second == leaf)
+                    continue;
+
+                for (uint32_t o = source.first; o < source.first + source.count; ++o)
+                    near.kernel.add(tree.bodies[o].position, tree.bodies[o].mass, tree.bodies[o].radius);
+            }
+
+            near.kernel.finish();
+
+            near.bodies.resize(node.count);
+            near.accelerations.resize(node.count);
+            for (uint32_t k = 0; k < node.count; ++k)
+                near.bodies[k] = k;
+
+            near.kernel.accumulate(set, near.bodies.data(), node.count, near.accelerations.data());
+
+            for (uint32_t k = 0; k < node.count; ++k) {
+                const Octree::Body& body = tree.bodies[node.first + k];
+                powers(glm::dvec3(body.position) - glm::dvec3(node.centerOfMass), power);
+
+                double gradient[3] = {};
+                for (int axis = 0; axis < 3; ++axis)
+                    for (const auto& raised : raise[axis])
+                        gradient[axis] += local[raised.second] * power[raised.first];
+
+                accelerations[body.index] = near.accelerations[k] + glm::vec3(float(gradient[0]), float(gradient[1]), float(gradient[2]));
+            }
+        }
+    });
+}
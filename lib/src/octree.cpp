@@ -0,0 +1,182 @@
+#include "octree.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtx/norm.hpp>
+
+void Octree::build() {
+    nodes.clear();
+
+    if (bodies.empty())
+        return;
+
+    /* Find the bounds of all the bodies. */
+    glm::vec3 minimum = bodies.front().position;
+    glm::vec3 maximum = minimum;
+
+    for (const Body& body : bodies) {
+        minimum = glm::min(minimum, body.position);
+        maximum = glm::max(maximum, body.position);
+    }
+
+    /* The root is a cube around all the bodies, made slightly larger so nothing lands exactly on the edge. */
+    glm::vec3 size = maximum - minimum;
+
+    Node root;
+    root.center = (minimum + maximum) * 0.5f;
+    root.halfSize = glm::max(glm::max(size.x, size.y), glm::max(size.z, 1.0e-3f)) * 0.5f * 1.001f;
+    root.first = 0;
+    root.count = uint32_t(bodies.size());
+
+    nodes.push_back(root);
+    sortBuffer.resize(bodies.size());
+
+    buildNode(0, 0);
+}
+
+void Octree::buildNode(uint32_t index, uint32_t depth) {
+    /* Copy what we need, because the node list can get reallocated when adding children. */
+    const glm::vec3 center = nodes[index].center;
+    const float halfSize = nodes[index].halfSize;
+    const uint32_t first = nodes[index].first;
+    const uint32_t count = nodes[index].count;
+
+    nodes[index].firstChild = 0;
+    nodes[index].childCount = 0;
+
+    if (count > leafSize && depth < maxDepth) {
+        /* Count the bodies in each octant. Bit 0 is x, bit 1 is y, bit 2 is z. */
+        uint32_t octantCounts[8] = {};
+
+        for (uint32_t i = first; i < first + count; ++i) {
+            const glm::vec3& p = bodies[i].position;
+            ++octantCounts[(p.x > center.x) | ((p.y > center.y) << 1) | ((p.z > center.z) << 2)];
+        }
+
+        /* Work out where each octant starts in the body list. */
+        uint32_t octantStarts[8];
+        uint32_t offset = first;
+        for (int o = 0; o < 8; ++o) {
+            octantStarts[o] = offset;
+            offset += octantCounts[o];
+        }
+
+        /* Sort the bodies into their octants. */
+        uint32_t octantNext[8];
+        std::copy(octantStarts, octantStarts + 8, octantNext);
+
+        for (uint32_t i = first; i < first + count; ++i) {
+            const glm::vec3& p = bodies[i].position;
+            sortBuffer[octantNext[(p.x > center.x) | ((p.y > center.y) << 1) | ((p.z > center.z) << 2)]++] = bodies[i];
+        }
+        std::copy(sortBuffer.begin() + first, sortBuffer.begin() + first + count, bodies.begin() + first);
+
+        /* Add the non-empty children next to each other. */
+        const uint32_t firstChild = uint32_t(nodes.size());
+        const float childHalfSize = halfSize * 0.5f;
+
+        for (int o = 0; o < 8; ++o) {
+            if (octantCounts[o] == 0)
+                continue;
+
+            Node child;
+            child.center = center + glm::vec3(o & 1 ? childHalfSize : -childHalfSize,
+                                              o & 2 ? childHalfSize : -childHalfSize,
+                                              o & 4 ? childHalfSize : -childHalfSize);
+            child.halfSize = childHalfSize;
+            child.first = octantStarts[o];
+            child.count = octantCounts[o];
+
+            nodes.push_back(child);
+        }
+
+        const uint32_t childCount = uint32_t(nodes.size()) - firstChild;
+
+        for (uint32_t c = firstChild; c < firstChild + childCount; ++c)
+            buildNode(c, depth + 1);
+
+        /* Combine the children into this node. */
+        glm::vec3 weighted;
+        float mass = 0.0f;
+
+        for (uint32_t c = firstChild; c < firstChild + childCount; ++c) {
+            weighted += nodes[c].centerOfMass * nodes[c].mass;
+            mass += nodes[c].mass;
+        }
+
+        Node& node = nodes[index];
+        node.firstChild = firstChild;
+        node.childCount = childCount;
+        node.mass = mass;
+        node.centerOfMass = mass > 0.0f ? weighted / mass : center;
+    } else {
+        /* This is a leaf, just add up the bodies. */
+        glm::vec3 weighted;
+        float mass = 0.0f;
+
+        for (uint32_t i = first; i < first + count; ++i) {
+            weighted += bodies[i].position * bodies[i].mass;
+            mass += bodies[i].mass;
+        }
+
+        Node& node = nodes[index];
+        node.mass = mass;
+        node.centerOfMass = mass > 0.0f ? weighted / mass : center;
+    }
+}
+
+glm::vec3 Octree::acceleration(uint32_t body, float theta, float* encounter) const {
+    const glm::vec3 position = bodies[body].position;
+    const float mass = bodies[body].mass;
+    const float radius = bodies[body].radius;
+    const float theta2 = theta * theta;
+
+    glm::vec3 result;
+    float strongest = 0.0f;
+
+    /* Every level can push at most 8 children, plus one for the root. */
+    uint32_t stack[maxDepth * 8 + 1];
+    uint32_t top = 0;
+
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+
+        glm::vec3 direction = node.centerOfMass - position;
+        float distance2 = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+        /* A node can be treated as a single body if it's far enough away compared to its size, and doesn't contain this body. */
+        glm::vec3 offset = glm::abs(position - node.center);
+        bool inside = offset.x <= node.halfSize && offset.y <= node.halfSize && offset.z <= node.halfSize;
+
+        if (!inside && 4.0f * node.halfSize * node.halfSize < theta2 * distance2) {
+            const float inverse3 = 1.0f / (distance2 * glm::sqrt(distance2));
+            result += direction * (node.mass * inverse3);
+            strongest = glm::max(strongest, (mass + node.mass) * inverse3);
+        } else if (node.childCount == 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (i == body)
+                    continue;
+
+                direction = bodies[i].position - position;
+                distance2 = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+                /* Planets close enough to merge don't pull on each other. */
+                float touching = radius + bodies[i].radius;
+                if (distance2 >= touching * touching) {
+                    const float inverse3 = 1.0f / (distance2 * glm::sqrt(distance2));
+                    result += direction * (bodies[i].mass * inverse3);
+                    strongest = glm::max(strongest, (mass + bodies[i].mass) * inverse3);
+                }
+            }
+        } else {
+            for (uint32_t c = node.firstChild; c < node.firstChild + node.childCount; ++c)
+                stack[top++] = c;
+        }
+    }
+
+    if (encounter != nullptr)
+        *encounter = strongest;
+
+    return result;
+}
@@ -104,7 +104,7 @@ bool PlacingInterface::handleMouseClick(const glm::ivec2& pos, const Camera& cam
         step = NotPlacing;
 
         if (universe.isSelectedValid()) {
-            universe.addOrbital(universe.getSelected(), orbitalRadius, planet.mass(), rotation);
+            universe.addOrbital(universe.selected, orbitalRadius, planet.mass(), rotation);
 
             orbitalRadius = 0.0f;
             return true;
@@ -5,22 +5,39 @@ Planet::Planet(glm::vec3 p, glm::vec3 v, float m) : position(p), velocity(v) {
     setMass(m);
 }
 
-void Planet::updatePath(size_t pathLength, float pathRecordDistance) {
-    /* If we have gone far enough, add a new point to the path. */
-    if (path.size() < 2 || glm::distance2(path[path.size() - 2], position) > pathRecordDistance)
+/* Does going from a to b to c turn by more than the angle with the cosine? */
+static bool isTurn(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float cosine) {
+    if (cosine >= 1.0f)
+        return true;
+
+    const glm::vec3 before = b - a;
+    const glm::vec3 after = c - b;
+
+    /* Compare squares to avoid the square roots, the sign has to be checked separately. */
+    const float dot = glm::dot(before, after);
+    const float limit = cosine * cosine * glm::length2(before) * glm::length2(after);
+    return cosine >= 0.0f ? dot <= 0.0f || dot * dot < limit : dot < 0.0f && dot * dot > limit;
+}
+
+void updatePath(Trail& path, const glm::vec3& position, size_t pathLength, float pathRecordDistance, float pathRecordCosine) {
+    /* Points past the limit drop off the old end as new ones get added. */
+    path.setCapacity(pathLength);
+
+    /* If we have gone far enough, and the path has turned since the last point, add a new point to the path. */
+    if (path.size() < 2 || (glm::distance2(path[path.size() - 2], position) > pathRecordDistance &&
+                            (path.size() < 3 || isTurn(path[path.size() - 3], path[path.size() - 2], position, pathRecordCosine))))
         path.push_back(position);
     else
         /* Otherwise update the last element to the current position. */
-        path.back() = position;
-
-    /* Delete any elements beyond the path size limit. */
-    if (path.size() > pathLength)
-        path.erase(path.begin(), path.end() - pathLength);
+        path.setBack(position);
 }
 
 void Planet::setMass(const float& m) {
     mass_p = m;
+    radius_p = radiusFromMass(m);
+}
 
+float Planet::radiusFromMass(const float& m) {
     /* Don't bother calculating the radius if the mass is zero or less. */
-    radius_p = m <= 0.0f ? 0.0f : std::cbrt((3.0f * m / 4.0f) * glm::pi<float>());
+    return m <= 0.0f ? 0.0f : std::cbrt((3.0f * m / 4.0f) * glm::pi<float>());
 }
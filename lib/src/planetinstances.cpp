@@ -0,0 +1,62 @@
+#include "planetinstances.h"
+#include "camera.h"
+#include <algorithm>
+
+void PlanetInstances::update(const PlanetsUniverse& universe, const Camera& camera, float scale) {
+    /* How many pixels something one unit across takes up, one unit away from the camera. */
+    const float pixelsPerUnit = camera.projection[1][1] * camera.getViewport().w * 0.5f;
+
+    /* With a fixed timestep the planets get drawn between their last two steps. */
+    const glm::vec3* positions = universe.interpolatedPositions(interpolated);
+    const float* radii = universe.radiusData();
+
+    visible.clear();
+    if (cull) {
+        Frustum(camera.camera).cull(positions, radii, 0, universe.size(), scale, visible);
+    } else {
+        for (size_t i = 0; i < universe.size(); ++i)
+            visible.push_back(uint32_t(i));
+    }
+
+    planetLevels.resize(visible.size());
+
+    size_t counts[levels] = {};
+    /* The distance in front of the camera is the same as w after projecting. */
+    const glm::vec4 forward(camera.camera[0][3], camera.camera[1][3], camera.camera[2][3], camera.camera[3][3]);
+
+    for (size_t n = 0; n < visible.size(); ++n) {
+        const size_t i = visible[n];
+        const float radius = radii[i] * scale;
+        const float depth = glm::dot(forward, glm::vec4(positions[i], 1.0f));
+
+        int level = 0;
+
+        if (depth > radius) {
+            const float pixels = radius * pixelsPerUnit / depth;
+            while (level < levels - 1 && pixels < levelPixels[level])
+                ++level;
+        } else if (depth < -radius) {
+            /* Completely behind the camera, it won't be seen at all. Only happens without culling. */
+            level = levels - 1;
+        }
+        /* Otherwise the camera is inside it or close enough to almost be, so it needs all the detail it can get. */
+
+        planetLevels[n] = uint8_t(level);
+        ++counts[level];
+    }
+
+    levelStart[0] = 0;
+    for (int level = 0; level < levels; ++level)
+        levelStart[level + 1] = levelStart[level] + counts[level];
+
+    /* Put each planet after the rest of its level. */
+    size_t next[levels];
+    std::copy(levelStart, levelStart + levels, next);
+
+    instances.resize(visible.size());
+
+    for (size_t n = 0; n < visible.size(); ++n) {
+        const size_t i = visible[n];
+        instances[next[planetLevels[n]]++] = glm::vec4(positions[i], radii[i] * scale);
+    }
+}
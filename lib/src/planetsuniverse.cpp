@@ -1,13 +1,19 @@
 #include "planetsuniverse.h"
 #include "planet.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <glm/gtx/norm.hpp>
 #include <glm/gtx/vector_query.hpp>
 #include <glm/gtx/rotate_vector.hpp>
-#include <glm/gtc/random.hpp>
+#include <glm/gtc/constants.hpp>
 #include <cstdio>
 
 #ifndef EMSCRIPTEN
+#include "mappedfile.h"
+#include "xmlreader.h"
+#include <cstring>
+#include <fstream>
 #include <tinyxml.h>
 #endif
 
@@ -16,57 +22,326 @@ using std::uniform_real_distribution;
 
 PlanetsUniverse::PlanetsUniverse() : generator(std::chrono::system_clock::now().time_since_epoch().count()) { }
 
+const int PlanetsUniverse::maxTimestepLevels;
+
 /* Emscripten does IO from javascript. */
 #ifndef EMSCRIPTEN
 
-int PlanetsUniverse::load(const std::string& filename, bool clear) {
-    TiXmlDocument doc(filename);
+const char* const PlanetsUniverse::binaryExtension = ".p3d";
+const uint32_t PlanetsUniverse::binaryVersion;
+
+/* The start of a binary universe file. After it come the positions and velocities as 3 floats per planet, then the masses.
+ * With HasPaths, that's followed by the number of points in each path as a uint32, then every path's points as 3 floats,
+ * oldest first. Velocities are stored as they are in the simulation, without the velocity factor XML uses. */
+struct BinaryHeader {
+    enum Flags : uint32_t {
+        HasPaths = 1
+    };
+
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t count;
+    uint64_t pathPoints;
+};
+
+static_assert(sizeof(BinaryHeader) == 32, "The binary header can't have any padding.");
+
+static const char binaryMagic[8] = { 'P', '3', 'D', 'U', 'N', 'I', 'V', '\n' };
 
-    if (!doc.LoadFile())
-        throw std::runtime_error("Unable to load file \"" + filename + "\"!\n" + doc.ErrorDesc());
+static bool isLittleEndian() {
+    const uint32_t one = 1;
+    return reinterpret_cast<const unsigned char&>(one) == 1;
+}
+
+/* Reverse the bytes of every 32 bit word, for converting to and from little endian on a big endian machine. */
+static void swapWords(void* data, size_t words) {
+    uint32_t* word = static_cast<uint32_t*>(data);
+    for (size_t i = 0; i < words; ++i)
+        word[i] = (word[i] >> 24) | ((word[i] >> 8) & 0xff00) | ((word[i] << 8) & 0xff0000) | (word[i] << 24);
+}
+
+static uint64_t swapLong(uint64_t value) {
+    uint32_t words[2] = { uint32_t(value >> 32), uint32_t(value) };
+    swapWords(words, 2);
+    return uint64_t(words[1]) << 32 | words[0];
+}
 
-    TiXmlElement* root = doc.FirstChildElement("planets-3d-universe");
-    if (root == nullptr)
+/* Copy count items out of a file, moving along the position. The file has already been checked to be big enough. */
+template <typename T> static void readBlock(const char*& position, T* into, size_t count) {
+    std::memcpy(into, position, count * sizeof(T));
+    position += count * sizeof(T);
+
+    if (!isLittleEndian())
+        swapWords(into, count * sizeof(T) / sizeof(uint32_t));
+}
+
+/* Write count items to a file, going through scratch if the bytes have to be swapped first. */
+template <typename T> static void writeBlock(std::ofstream& file, const T* data, size_t count, std::vector<uint32_t>& scratch) {
+    const size_t bytes = count * sizeof(T);
+
+    if (isLittleEndian()) {
+        file.write(reinterpret_cast<const char*>(data), std::streamsize(bytes));
+    } else {
+        scratch.resize(bytes / sizeof(uint32_t));
+        std::memcpy(scratch.data(), data, bytes);
+        swapWords(scratch.data(), scratch.size());
+        file.write(reinterpret_cast<const char*>(scratch.data()), std::streamsize(bytes));
+    }
+}
+
+int PlanetsUniverse::load(const std::string& filename, bool clear, const LoadProgress& progress) {
+    MappedFile file(filename);
+    if (!file.isOpen())
+        throw std::runtime_error("Unable to load file \"" + filename + "\"!");
+
+    if (file.size() >= sizeof(binaryMagic) && std::memcmp(file.data(), binaryMagic, sizeof(binaryMagic)) == 0)
+        return loadBinary(file, filename, clear);
+
+    return loadXml(file, filename, clear, progress);
+}
+
+/* The value of an attribute the loader can't do without. */
+static const std::string& requiredAttribute(const XmlReader& reader, const char* name) {
+    const std::string* value = reader.attribute(name);
+    if (value == nullptr)
+        throw std::runtime_error("<" + reader.name() + "> is missing " + name + "!");
+    return *value;
+}
+
+static glm::vec3 readVector(const XmlReader& reader) {
+    return glm::vec3(std::stof(requiredAttribute(reader, "x")),
+                     std::stof(requiredAttribute(reader, "y")),
+                     std::stof(requiredAttribute(reader, "z")));
+}
+
+int PlanetsUniverse::loadXml(const MappedFile& file, const std::string& filename, bool clear, const LoadProgress& progress) {
+    XmlReader reader(file.data(), file.size());
+
+    /* The planets are only added once the whole file has been read, so a bad file doesn't leave half a universe behind. */
+    std::vector<Planet> planets;
+
+    /* Report progress about a hundred times over the whole file. */
+    const size_t progressStep = std::max<size_t>(file.size() / 100, 1);
+    size_t nextProgress = progressStep;
+
+    bool foundRoot = false, inRoot = false, inPlanet = false;
+    Planet planet;
+
+    try {
+        for (XmlReader::Event event = reader.next(); event != XmlReader::EndDocument; event = reader.next()) {
+            if (event == XmlReader::StartElement) {
+                if (reader.depth() == 1 && !foundRoot && reader.name() == "planets-3d-universe") {
+                    foundRoot = inRoot = true;
+
+                    /* Saved files say how many planets they have. Older ones are about 170 bytes a planet. */
+                    const std::string* count = reader.attribute("count");
+                    const size_t hint = count != nullptr ? size_t(std::stoul(*count)) : file.size() / 170;
+                    /* Never trust it with more than could actually fit in the file. */
+                    planets.reserve(std::min(hint, file.size() / 16));
+                } else if (inRoot && reader.depth() == 2 && reader.name() == "planet") {
+                    planet = Planet();
+                    planet.setMass(std::stof(requiredAttribute(reader, "mass")));
+                    inPlanet = true;
+                } else if (inPlanet && reader.depth() == 3) {
+                    if (reader.name() == "position")
+                        planet.position = readVector(reader);
+                    else if (reader.name() == "velocity")
+                        /* Velocity is saved with velocity factor. */
+                        planet.velocity = readVector(reader) * velocityfac;
+                }
+            } else if (inPlanet && reader.depth() == 2) {
+                planets.push_back(planet);
+                inPlanet = false;
+            } else if (inRoot && reader.depth() == 1) {
+                inRoot = false;
+            }
+
+            if (progress && reader.position() >= nextProgress) {
+                nextProgress = reader.position() + progressStep;
+                if (!progress(float(reader.position()) / float(file.size())))
+                    return 0;
+            }
+        }
+    } catch (const std::exception& error) {
+        throw std::runtime_error("Unable to load file \"" + filename + "\"!\n" + error.what());
+    }
+
+    if (!foundRoot)
         throw std::runtime_error("\"" + filename + "\" is not a valid universe file!");
 
     if (clear)
         deleteAll();
 
-    /* Keep track of how many planets were loaded. */
-    int loaded = 0;
-
-    for (TiXmlElement* element = root->FirstChildElement(); element != nullptr; element = element->NextSiblingElement()) {
-        if (element->ValueStr() == "planet") {
-            Planet planet;
-            planet.setMass(std::stof(element->Attribute("mass")));
-
-            for (TiXmlElement* sub = element->FirstChildElement(); sub != nullptr; sub = sub->NextSiblingElement()) {
-                if (sub->ValueStr() == "position")
-                    planet.position = glm::vec3(std::stof(sub->Attribute("x")),
-                                                std::stof(sub->Attribute("y")),
-                                                std::stof(sub->Attribute("z")));
-                else if (sub->ValueStr() == "velocity")
-                    /* Velocity is saved with velocity factor. */
-                    planet.velocity = glm::vec3(std::stof(sub->Attribute("x")),
-                                                std::stof(sub->Attribute("y")),
-                                                std::stof(sub->Attribute("z"))) * velocityfac;
-            }
-            addPlanet(planet);
-            ++loaded;
+    positions.reserve(size() + planets.size());
+    velocities.reserve(size() + planets.size());
+    masses.reserve(size() + planets.size());
+    radii.reserve(size() + planets.size());
+    paths.reserve(size() + planets.size());
+
+    for (const Planet& loaded : planets)
+        addPlanet(loaded);
+
+    if (progress)
+        progress(1.0f);
+
+    return int(planets.size());
+}
+
+int PlanetsUniverse::loadBinary(const MappedFile& file, const std::string& filename, bool clear) {
+    BinaryHeader header;
+    if (file.size() < sizeof(header))
+        throw std::runtime_error("\"" + filename + "\" is not a valid universe file!");
+
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (!isLittleEndian()) {
+        swapWords(&header.version, 2);
+        header.count = swapLong(header.count);
+        header.pathPoints = swapLong(header.pathPoints);
+    }
+
+    if (header.version > binaryVersion)
+        throw std::runtime_error("\"" + filename + "\" was saved by a newer version of Planets3D!");
+
+    /* Make sure everything the header says is there actually is, without letting the sizes overflow. */
+    const bool hasPaths = (header.flags & BinaryHeader::HasPaths) != 0;
+    const uint64_t available = file.size() - sizeof(header);
+    const uint64_t planetBytes = sizeof(glm::vec3) * 2 + sizeof(float) + (hasPaths ? sizeof(uint32_t) : 0);
+
+    if (header.count > available / planetBytes ||
+        header.pathPoints > (available - header.count * planetBytes) / sizeof(glm::vec3))
+        throw std::runtime_error("\"" + filename + "\" is cut off or corrupt!");
+
+    /* Check the rest before changing anything, so a bad file leaves the universe the way it was. */
+    if (header.count > SlotMap::maxSize - (clear ? 0 : size()))
+        throw std::runtime_error("\"" + filename + "\" has more planets than can fit in the universe!");
+
+    const size_type count = size_type(header.count);
+    const char* position = file.data() + sizeof(header);
+
+    /* The path sizes come after the positions, velocities and masses, and have to add up to the points after them. */
+    std::vector<uint32_t> pathSizes;
+    if (hasPaths) {
+        const char* sizes = position + count * (sizeof(glm::vec3) * 2 + sizeof(float));
+        pathSizes.resize(count);
+        readBlock(sizes, pathSizes.data(), count);
+
+        uint64_t total = 0;
+        for (uint32_t pathSize : pathSizes)
+            total += pathSize;
+
+        if (total != header.pathPoints)
+            throw std::runtime_error("\"" + filename + "\" is cut off or corrupt!");
+    }
+
+    if (clear)
+        deleteAll();
+
+    const size_type first = size();
+
+    positions.resize(first + count);
+    velocities.resize(first + count);
+    masses.resize(first + count);
+    radii.resize(first + count);
+    paths.resize(first + count);
+
+    readBlock(position, positions.data() + first, count);
+    readBlock(position, velocities.data() + first, count);
+    readBlock(position, masses.data() + first, count);
+
+    for (size_type i = first; i < first + count; ++i)
+        radii[i] = Planet::radiusFromMass(masses[i]);
+
+    if (hasPaths) {
+        position += count * sizeof(uint32_t);
+
+        std::vector<glm::vec3> points;
+
+        for (size_type i = 0; i < count; ++i) {
+            points.resize(pathSizes[i]);
+            readBlock(position, points.data(), points.size());
+
+            Trail& path = paths[first + i];
+            path.clear();
+            path.setCapacity(pathLength);
+            for (const glm::vec3& point : points)
+                path.push_back(point);
         }
     }
 
-    return loaded;
+    for (size_type i = 0; i < count; ++i)
+        slots.insert();
+    ++edits;
+
+    return int(count);
+}
+
+void PlanetsUniverse::saveBinary(const std::string& filename) const {
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+        throw std::runtime_error("Unable to write to \"" + filename + "\"!");
+
+    std::vector<uint32_t> pathSizes(size());
+    uint64_t pathPoints = 0;
+    for (size_type i = 0; i < size(); ++i) {
+        pathSizes[i] = uint32_t(paths[i].size());
+        pathPoints += pathSizes[i];
+    }
+
+    BinaryHeader header;
+    std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+    header.version = binaryVersion;
+    header.flags = BinaryHeader::HasPaths;
+    header.count = size();
+    header.pathPoints = pathPoints;
+
+    if (!isLittleEndian()) {
+        swapWords(&header.version, 2);
+        header.count = swapLong(header.count);
+        header.pathPoints = swapLong(header.pathPoints);
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<uint32_t> scratch;
+    writeBlock(file, positions.data(), size(), scratch);
+    writeBlock(file, velocities.data(), size(), scratch);
+    writeBlock(file, masses.data(), size(), scratch);
+    writeBlock(file, pathSizes.data(), size(), scratch);
+
+    /* Each path can be in two pieces, written one after the other they come out in order. */
+    for (const Trail& path : paths) {
+        Trail::Span spans[2];
+        const size_t count = path.spans(spans);
+
+        /* The first span of a wrapped path also has the copy of the first point leading into the second span. */
+        if (count == 2)
+            --spans[0].size;
+
+        for (size_t s = 0; s < count; ++s)
+            writeBlock(file, spans[s].data, spans[s].size, scratch);
+    }
+
+    if (!file)
+        throw std::runtime_error("Unable to write to \"" + filename + "\"!");
 }
 
 void PlanetsUniverse::save(const std::string& filename) {
+    const size_t extension = std::strlen(binaryExtension);
+    if (filename.size() >= extension && filename.compare(filename.size() - extension, extension, binaryExtension) == 0) {
+        saveBinary(filename);
+        return;
+    }
+
     TiXmlDocument doc;
 
     doc.LinkEndChild(new TiXmlDeclaration("1.0", "", ""));
 
     TiXmlElement* root = new TiXmlElement("planets-3d-universe");
+    /* Lets the loader set aside enough room before reading any planets. */
+    root->SetAttribute("count", std::to_string(size()));
 
-    for (const Planet& planet : planets) {
+    for (const auto& planet : *this) {
         TiXmlElement* element = new TiXmlElement("planet");
         element->SetAttribute("mass", std::to_string(planet.mass()));
 
@@ -103,85 +378,726 @@ static float fastInverseSqrt(float x) {
     return x*(1.5f - halfx*x*x);
 }
 
+/* Adds the time between being made and going out of scope to a total. */
+class PhaseTimer {
+    double& total;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    PhaseTimer(double& total) : total(total), start(std::chrono::steady_clock::now()) { }
+    ~PhaseTimer() { total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); }
+};
+
+/* Yoshida's fourth order integrator is three leapfrog steps of these lengths, the middle one going backwards in time.
+ * Written as drift, kick, drift, kick, drift, kick, drift. */
+static const float yoshidaDrift[4] = { 0.6756035959798289f, -0.1756035959798288f, -0.1756035959798288f, 0.6756035959798289f };
+static const float yoshidaKick[3] = { 1.3512071919596578f, -1.7024143839193153f, 1.3512071919596578f };
+
 void PlanetsUniverse::advance(float time) {
-    /* Factor the simulation speed and number of steps into the time value. */
-    time *= simspeed / stepsPerFrame;
+    int steps = stepsPerFrame;
+
+    if (fixedTimestep && fixedStep > 0.0f) {
+        accumulator += double(time) * simspeed;
+        steps = int(std::max(0.0, std::floor(accumulator / fixedStep)));
+
+        if (steps > maxFixedSteps) {
+            /* Too far behind to catch up, start over from the last step taken. */
+            steps = maxFixedSteps;
+            accumulator = 0.0;
+        } else {
+            accumulator -= double(steps) * fixedStep;
+        }
 
+        time = fixedStep;
+        alpha = float(std::min(std::max(accumulator / fixedStep, 0.0), 1.0));
+    } else {
+        /* Factor the simulation speed and number of steps into the time value. */
+        time *= simspeed / stepsPerFrame;
+
+        /* Each frame ends right on a step, there's nothing to blend. */
+        accumulator = 0.0;
+        alpha = 1.0f;
+        previousPositions.clear();
+    }
+
+    /* Never try to use instructions the CPU doesn't have. */
+    const GravityKernel::InstructionSet set = std::min(instructionSet, GravityKernel::detect());
+
+    /* Nothing to do until a whole fixed step has built up. */
+    if (steps == 0)
+        return;
+
+    pool.resize(threadCount == 0 ? ThreadPool::hardwareThreads() : threadCount);
+    threadAccelerations.resize(pool.size());
+
+    if (timestepLevels > 0) {
+        advanceBlocks(set, time, steps);
+        return;
+    }
+
+    closingForces.valid = false;
+
+    for (int s = 0; s < steps; ++s) {
+        if (fixedTimestep && s == steps - 1)
+            savePrevious();
+
+        switch (integrator) {
+        case Leapfrog:
+            drift(time * 0.5f);
+            kick(set, time);
+            drift(time * 0.5f);
+            break;
+        case Yoshida4:
+            for (int k = 0; k < 3; ++k) {
+                drift(time * yoshidaDrift[k]);
+                kick(set, time * yoshidaKick[k]);
+            }
+            drift(time * yoshidaDrift[3]);
+            break;
+        default:
+            kick(set, time);
+            drift(time);
+            break;
+        }
+
+        /* Paths only care about where the planets end up. */
+        recordPaths(time, s == steps - 1);
+    }
+
+    /* Everything stays on the full step. */
+    occupancy.assign(1, size());
+}
+
+void PlanetsUniverse::savePrevious() {
+    previousPositions = positions;
+    previousEdits = edits;
+}
+
+const glm::vec3* PlanetsUniverse::interpolatedPositions(std::vector<glm::vec3>& positions) const {
+    if (!canInterpolate() || alpha >= 1.0f)
+        return positionData();
+
+    positions.resize(size());
+    for (size_type i = 0; i < size(); ++i)
+        positions[i] = previousPositions[i] + (this->positions[i] - previousPositions[i]) * alpha;
+
+    return positions.data();
+}
+
+void PlanetsUniverse::recordPaths(float time, bool lastStep) {
+    if (pathLength == 0)
+        return;
+
+    switch (pathRecording) {
+    case EveryFrame:
+        if (!lastStep)
+            return;
+        break;
+    case EveryInterval:
+        pathTime += time;
+        if (pathTime < pathRecordInterval)
+            return;
+        /* Don't try to catch up on any intervals that were missed, one update covers all of them. */
+        pathTime = pathRecordInterval > 0.0f ? std::fmod(pathTime, pathRecordInterval) : 0.0f;
+        break;
+    default:
+        break;
+    }
+
+    PhaseTimer timer(phaseTimes.paths);
+
+    const float cosine = std::cos(pathRecordAngle);
+    for (size_type i = 0; i < size(); ++i)
+        updatePath(paths[i], positions[i], pathLength, pathRecordDistance, cosine);
+}
+
+void PlanetsUniverse::advanceBlocks(GravityKernel::InstructionSet set, float time, int steps) {
+    const int maxLevel = std::min(timestepLevels, maxTimestepLevels);
+    const uint32_t ticks = uint32_t(1) << maxLevel;
+    const float tick = time / ticks;
+
+    /* The forces from the end of the last frame still hold if nothing has moved or changed how they're calculated since. */
+    const bool reuseForces = closingForces.valid && closingForces.edits == edits && closingForces.count == size() &&
+            closingForces.set == set && closingForces.forceBackend == forceBackend && closingForces.barnesHutTheta == barnesHutTheta;
+    closingForces.valid = false;
+
+    /* Every planet lines up with the start of a step, so the levels can start over every frame. */
+    levels.assign(size(), 0);
+    halfSteps.assign(size(), 0.0f);
+
+    auto sortLevels = [this, maxLevel]() {
+        onLevel.resize(maxLevel + 1);
+        for (std::vector<uint32_t>& planets : onLevel)
+            planets.clear();
+
+        for (size_type i = 0; i < size(); ++i)
+            onLevel[levels[i]].push_back(uint32_t(i));
+    };
+
+    sortLevels();
+
+    for (int s = 0; s < steps; ++s) {
+        if (fixedTimestep && s == steps - 1)
+            savePrevious();
+
+        for (uint32_t t = 0; t < ticks;) {
+            /* A planet on level l takes a step every ticks / 2^l ticks, so every level from the first one lined up with this tick does. */
+            int aligned = 0;
+            while ((t & ((ticks >> aligned) - 1)) != 0)
+                ++aligned;
+
+            active.clear();
+            for (int level = aligned; level <= maxLevel; ++level) {
+                active.insert(active.end(), onLevel[level].begin(), onLevel[level].end());
+                onLevel[level].clear();
+            }
+
+            /* At the very start every planet is on level 0 and active in order, just like for the forces left from last time. */
+            if (!(reuseForces && s == 0 && t == 0)) {
+                PhaseTimer timer(phaseTimes.gravity);
+                gravityActive(set);
+                forceEvaluations += active.size();
+            }
+
+            {
+                PhaseTimer timer(phaseTimes.integration);
+
+                for (size_t k = 0; k < active.size(); ++k) {
+                    const uint32_t i = active[k];
+
+                    /* A planet can only move up to a longer step if this tick is the start of one. */
+                    const float wanted = encounters[k] > 0.0f ? timestepAccuracy / std::sqrt(gravityconst * encounters[k]) : time;
+                    int level = aligned;
+                    float step = time / float(uint32_t(1) << aligned);
+
+                    while (level < maxLevel && step > wanted) {
+                        ++level;
+                        step *= 0.5f;
+                    }
+
+                    /* Finish the last step with the second half of its kick, and start the new one with the first half.
+                     * Kept as two kicks so the result is the same when the last step was finished at the end of a frame. */
+                    velocities[i] += accelerations[k] * (gravityconst * halfSteps[i]);
+                    velocities[i] += accelerations[k] * (gravityconst * step * 0.5f);
+                    halfSteps[i] = step * 0.5f;
+                    levels[i] = uint8_t(level);
+
+                    onLevel[level].push_back(i);
+                }
+            }
+
+            {
+                PhaseTimer timer(phaseTimes.merging);
+                findMerges();
+
+                /* Merging moves planets around and changes levels. */
+                if (!merges.empty()) {
+                    resolveMerges();
+                    sortLevels();
+                }
+            }
+
+            /* Nothing happens until the next tick the shortest step lines up with, so drift straight there. */
+            int highest = maxLevel;
+            while (highest > 0 && onLevel[highest].empty())
+                --highest;
+
+            const uint32_t skip = ticks >> highest;
+            drift(tick * float(skip));
+            t += skip;
+        }
+
+        recordPaths(time, s == steps - 1);
+    }
+
+    /* Give every planet the rest of its kick, so the velocities match the positions again between frames. */
+    active.resize(size());
+    for (size_type i = 0; i < size(); ++i)
+        active[i] = uint32_t(i);
+
+    {
+        PhaseTimer timer(phaseTimes.gravity);
+        gravityActive(set);
+    }
+    forceEvaluations += active.size();
+
+    for (size_type i = 0; i < size(); ++i)
+        velocities[i] += accelerations[i] * (gravityconst * halfSteps[i]);
+
+    closingForces.valid = true;
+    closingForces.edits = edits;
+    closingForces.count = size();
+    closingForces.set = set;
+    closingForces.forceBackend = forceBackend;
+    closingForces.barnesHutTheta = barnesHutTheta;
+
+    occupancy.assign(maxLevel + 1, 0);
+    for (uint8_t level : levels)
+        ++occupancy[level];
+
+    levels.clear();
+    halfSteps.clear();
+}
+
+void PlanetsUniverse::kick(GravityKernel::InstructionSet set, float time) {
     /* Premultiply the gravity constant by time so we don't have to keep doing it every time we calculate gravitational force. */
     const float gconsttime = gravityconst * time;
 
-    /* Store the list end iterator so we don't have to keep retrieving it. */
-    iterator e = planets.end();
+    {
+        PhaseTimer timer(phaseTimes.gravity);
+
+        switch (forceBackend) {
+        case BarnesHut:
+            gravityBarnesHut(gconsttime);
+            break;
+        case FastMultipole:
+            gravityMultipole(set, gconsttime);
+            break;
+        default:
+            /* The kernel sums each planet by itself, so it gives the same result with any number of threads. */
+            if (set != GravityKernel::Scalar || deterministic)
+                gravityVectorized(set, gconsttime);
+            else if (pool.size() > 1)
+                gravityDirectParallel(gconsttime);
+            else
+                gravityDirect(gconsttime);
+            break;
+        }
 
-    for (int s = 0; s < stepsPerFrame; ++s) {
-        for (iterator i = planets.begin(); i != e; ++i) {
-            /* We only have to run this for planets after the current one,
-             * because all the planets before this have already been calculated with this one. */
-            for (iterator o = i + 1; o != e;) {
-                glm::vec3 direction = o->position - i->position;
-                /* Don't use glm::length2 because it involves a conversion and extra multiply & add operations for a forth component. */
-                float force = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+        forceEvaluations += size();
+    }
 
-                /* Planets are close enough to merge. */
-                if (force < (i->radius() + o->radius()) * (i->radius() + o->radius())) {
-                    /* Set the position and velocity to the wieghted average between the planets. */
-                    i->position = o->position * o->mass() + i->position * i->mass();
-                    i->velocity = o->velocity * o->mass() + i->velocity * i->mass();
+    /* Collisions are handled separately from gravity, so they cost the same no matter how gravity is calculated. */
+    PhaseTimer timer(phaseTimes.merging);
+    findMerges();
+    resolveMerges();
+}
 
-                    /* Add the masses together. */
-                    i->setMass(i->mass() + o->mass());
+void PlanetsUniverse::gravityDirect(float gconsttime) {
+    /* Store the size so we don't have to keep retrieving it. */
+    const size_type count = size();
+
+    for (size_type i = 0; i < count; ++i) {
+        /* Keep everything about the current planet in local variables while going through the others. */
+        const glm::vec3 position = positions[i];
+        glm::vec3 velocity = velocities[i];
+        const float mass = masses[i];
+        const float radius = radii[i];
+
+        /* We only have to run this for planets after the current one,
+         * because all the planets before this have already been calculated with this one. */
+        for (size_type o = i + 1; o < count; ++o) {
+            glm::vec3 direction = positions[o] - position;
+            /* Don't use glm::length2 because it involves a conversion and extra multiply & add operations for a forth component. */
+            float force = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+            /* Planets close enough to merge don't pull on each other. */
+            if (force < (radius + radii[o]) * (radius + radii[o]))
+                continue;
+
+            /* The gravity math to calculate the force between the planets. */
+            force = gconsttime / force * fastInverseSqrt(force);
+
+            /* Apply the force to the velocity of both planets. */
+            velocity += force * masses[o] * direction;
+            velocities[o] -= force * mass * direction;
+        }
 
-                    /* Finish the weighted average calculation. */
-                    i->position /= i->mass();
-                    i->velocity /= i->mass();
+        velocities[i] = velocity;
+    }
+}
 
-                    /* The path would be invalid after this. */
-                    i->path.clear();
+/* How many planets to give a thread at once when each planet is handled separately. */
+static const size_t chunkSize = 64;
 
-                    /* This function checks selected and following to make sure they remain valid. */
-                    remove(o - begin(), i - begin());
+/* The number of planets on each side of a tile in the parallel direct method. */
+static const size_t tileSize = 128;
 
-                    /* Update the stored list end value. */
-                    e = planets.end();
-                } else {
-                    /* The gravity math to calculate the force between the planets. */
-                    force = gconsttime / force * fastInverseSqrt(force);
+void PlanetsUniverse::gravityDirectParallel(float gconsttime) {
+    const size_type count = size();
+    const size_type tiles = (count + tileSize - 1) / tileSize;
 
-                    /* Apply the force to the velocity of both planets. */
-                    i->velocity += force * o->mass() * direction;
-                    o->velocity -= force * i->mass() * direction;
+    /* Split the pairs of planets into square tiles, only the tiles on or above the diagonal are needed. */
+    tilePairs.clear();
+    for (uint32_t a = 0; a < tiles; ++a)
+        for (uint32_t b = a; b < tiles; ++b)
+            tilePairs.push_back(std::make_pair(a, b));
 
-                    /* Keep going. (Not in for loop because of the possibility of erase() getting called.) */
-                    ++o;
-                }
+    /* Task t runs on thread t, so every thread clears its own accumulator. */
+    pool.run(pool.size(), [this, count](size_t, unsigned int thread) {
+        threadAccelerations[thread].assign(count, glm::vec3());
+    });
+
+    pool.run(tilePairs.size(), [this, count](size_t task, unsigned int thread) {
+        glm::vec3* result = threadAccelerations[thread].data();
+
+        const size_type firstA = tilePairs[task].first * tileSize, lastA = std::min(firstA + tileSize, count);
+        const size_type firstB = tilePairs[task].second * tileSize, lastB = std::min(firstB + tileSize, count);
+
+        for (size_type i = firstA; i < lastA; ++i) {
+            const glm::vec3 position = positions[i];
+            const float mass = masses[i];
+            const float radius = radii[i];
+            glm::vec3 sum;
+
+            /* Tiles on the diagonal would see every pair twice otherwise. */
+            for (size_type o = firstA == firstB ? i + 1 : firstB; o < lastB; ++o) {
+                glm::vec3 direction = positions[o] - position;
+                float force = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+
+                if (force < (radius + radii[o]) * (radius + radii[o]))
+                    continue;
+
+                force = fastInverseSqrt(force) / force;
+
+                /* The same force pulls both planets, this thread is the only one touching its copy of each. */
+                sum += force * masses[o] * direction;
+                result[o] -= force * mass * direction;
             }
 
-            /* Apply the velocity to the position of the planet and update the path. */
-            i->position += i->velocity * time;
-            i->updatePath(pathLength, pathRecordDistance);
+            result[i] += sum;
         }
+    });
+
+    /* Add up what each thread came up with, always in the same order. */
+    pool.run((count + chunkSize - 1) / chunkSize, [this, count, gconsttime](size_t task, unsigned int) {
+        for (size_type i = task * chunkSize; i < std::min((task + 1) * chunkSize, count); ++i) {
+            glm::vec3 sum;
+            for (const auto& result : threadAccelerations)
+                sum += result[i];
+
+            velocities[i] += sum * gconsttime;
+        }
+    });
+}
+
+void PlanetsUniverse::gravityVectorized(GravityKernel::InstructionSet set, float gconsttime) {
+    const size_type count = size();
+
+    /* The kernel visits every pair twice, but does so many at once that it still ends up much faster.
+     * It also means each planet can be done by any thread without having to combine anything afterwards. */
+    kernel.load(positions.data(), masses.data(), radii.data(), count);
+
+    active.resize(count);
+    for (size_type i = 0; i < count; ++i)
+        active[i] = uint32_t(i);
+
+    accelerations.resize(count);
+
+    pool.run((count + chunkSize - 1) / chunkSize, [this, set, count, gconsttime](size_t task, unsigned int) {
+        const size_type first = task * chunkSize, last = std::min(first + chunkSize, count);
+
+        kernel.accumulate(set, active.data() + first, last - first, accelerations.data() + first);
+
+        for (size_type i = first; i < last; ++i)
+            velocities[i] += accelerations[i] * gconsttime;
+    });
+}
+
+void PlanetsUniverse::gravityBarnesHut(float gconsttime) {
+    /* Copy everything the tree needs into it. */
+    octree.bodies.resize(size());
+
+    for (uint32_t i = 0; i < size(); ++i) {
+        Octree::Body& body = octree.bodies[i];
+        body.position = positions[i];
+        body.mass = masses[i];
+        body.radius = radii[i];
+        body.index = i;
     }
+
+    octree.build();
+
+    /* The tree is sorted differently than the planet list, so go through it in tree order. */
+    const size_t count = octree.bodies.size();
+
+    pool.run((count + chunkSize - 1) / chunkSize, [this, count, gconsttime](size_t task, unsigned int) {
+        for (size_t b = task * chunkSize; b < std::min((task + 1) * chunkSize, count); ++b)
+            velocities[octree.bodies[b].index] += octree.acceleration(uint32_t(b), barnesHutTheta) * gconsttime;
+    });
 }
 
-void PlanetsUniverse::remove(const key_type key, const key_type replacement) {
-    if (!isValid(key))
+void PlanetsUniverse::gravityMultipole(GravityKernel::InstructionSet set, float gconsttime) {
+    const size_type count = size();
+
+    accelerations.resize(count);
+    multipoleTree.solve(positions.data(), masses.data(), radii.data(), count, multipoleOrder, multipoleTheta, set, pool, accelerations.data());
+
+    for (size_type i = 0; i < count; ++i)
+        velocities[i] += accelerations[i] * gconsttime;
+}
+
+void PlanetsUniverse::gravityActive(GravityKernel::InstructionSet set) {
+    const size_type count = active.size();
+
+    accelerations.resize(count);
+    encounters.resize(count);
+
+    if (forceBackend != DirectSum) {
+        octree.bodies.resize(size());
+
+        for (uint32_t i = 0; i < size(); ++i) {
+            Octree::Body& body = octree.bodies[i];
+            body.position = positions[i];
+            body.mass = masses[i];
+            body.radius = radii[i];
+            body.index = i;
+        }
+
+        octree.build();
+
+        treeIndex.resize(size());
+        for (uint32_t b = 0; b < size(); ++b)
+            treeIndex[octree.bodies[b].index] = b;
+
+        pool.run((count + chunkSize - 1) / chunkSize, [this, count](size_t task, unsigned int) {
+            for (size_type k = task * chunkSize; k < std::min((task + 1) * chunkSize, count); ++k)
+                accelerations[k] = octree.acceleration(treeIndex[active[k]], barnesHutTheta, &encounters[k]);
+        });
+    } else {
+        /* Only the active planets feel anything, but every planet still pulls on them. The scalar kernel is the plain loop. */
+        kernel.load(positions.data(), masses.data(), radii.data(), size());
+
+        pool.run((count + chunkSize - 1) / chunkSize, [this, set, count](size_t task, unsigned int) {
+            const size_type first = task * chunkSize, last = std::min(first + chunkSize, count);
+            kernel.accumulate(set, active.data() + first, last - first, accelerations.data() + first, encounters.data() + first);
+        });
+    }
+}
+
+void PlanetsUniverse::findMerges() {
+    merges.clear();
+
+    const size_type count = size();
+    if (count < 2)
+        return;
+
+    /* Sweep along whichever axis the planets are most spread out on, so the fewest planets share the same stretch of it. */
+    glm::vec3 average, spread;
+
+    for (size_type i = 0; i < count; ++i)
+        average += positions[i];
+    average /= float(count);
+
+    for (size_type i = 0; i < count; ++i) {
+        glm::vec3 offset = positions[i] - average;
+        spread += offset * offset;
+    }
+
+    const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : spread.y >= spread.z ? 1 : 2;
+
+    /* Where each planet starts on the axis. */
+    sweepStart.resize(count);
+    for (size_type i = 0; i < count; ++i)
+        sweepStart[i] = positions[i][axis] - radii[i];
+
+    if (sweepOrder.size() != count) {
+        sweepOrder.resize(count);
+        for (size_type i = 0; i < count; ++i)
+            sweepOrder[i] = uint32_t(i);
+
+        std::sort(sweepOrder.begin(), sweepOrder.end(), [this](uint32_t a, uint32_t b) { return sweepStart[a] < sweepStart[b]; });
+    } else {
+        /* Planets barely move between steps, so the order from last time is almost sorted already. */
+        for (size_type i = 1; i < count; ++i) {
+            const uint32_t planet = sweepOrder[i];
+            size_type j = i;
+
+            for (; j > 0 && sweepStart[sweepOrder[j - 1]] > sweepStart[planet]; --j)
+                sweepOrder[j] = sweepOrder[j - 1];
+
+            sweepOrder[j] = planet;
+        }
+    }
+
+    /* Each planet only needs to be checked against the ones that start before it ends. */
+    for (size_type a = 0; a < count; ++a) {
+        const uint32_t i = sweepOrder[a];
+        const float end = positions[i][axis] + radii[i];
+
+        for (size_type b = a + 1; b < count && sweepStart[sweepOrder[b]] <= end; ++b) {
+            const uint32_t o = sweepOrder[b];
+            const float touching = radii[i] + radii[o];
+
+            if (glm::distance2(positions[i], positions[o]) < touching * touching)
+                merges.push_back(std::make_pair(std::min(i, o), std::max(i, o)));
+        }
+    }
+}
+
+void PlanetsUniverse::resolveMerges() {
+    if (merges.empty())
         return;
 
+    const size_type count = size();
+
+    /* Group the planets with a union-find, where the root of every group is its lowest planet. */
+    mergeParent.resize(count);
+    for (size_type i = 0; i < count; ++i)
+        mergeParent[i] = uint32_t(i);
+
+    auto find = [this](uint32_t planet) {
+        while (mergeParent[planet] != planet)
+            planet = mergeParent[planet] = mergeParent[mergeParent[planet]];
+        return planet;
+    };
+
+    for (const auto& pair : merges) {
+        uint32_t a = find(pair.first), b = find(pair.second);
+
+        if (a < b)
+            mergeParent[b] = a;
+        else if (b < a)
+            mergeParent[a] = b;
+    }
+
+    /* Every parent is now lower than its child, so going up from the bottom points everything straight at its root.
+     * Merging in the same order means the result doesn't depend on what order the pairs were found in. */
+    for (size_type i = 0; i < count; ++i) {
+        mergeParent[i] = mergeParent[mergeParent[i]];
+
+        if (mergeParent[i] != i) {
+            merge(mergeParent[i], i);
+
+            /* Whatever it merged into could be in for a much closer encounter, so give it the shortest step to be safe. */
+            if (!levels.empty())
+                levels[mergeParent[i]] = uint8_t(std::min(timestepLevels, maxTimestepLevels));
+        }
+    }
+
+    /* Anything selected or followed switches to whatever its group merged into. */
+    if (isValid(selected))
+        selected = slots.key(mergeParent[slots.index(selected)]);
+    if (isValid(following))
+        following = slots.key(mergeParent[slots.index(following)]);
+
+    /* Move every remaining planet down into the space left by the merged ones, all in one pass.
+     * This keeps the planets in the same order, so merging stays the same no matter how many threads found the pairs. */
+    size_type kept = 0;
+
+    for (size_type i = 0; i < count; ++i) {
+        if (mergeParent[i] != i) {
+            slots.release(i);
+            continue;
+        }
+
+        if (kept != i) {
+            positions[kept] = positions[i];
+            velocities[kept] = velocities[i];
+            masses[kept] = masses[i];
+            radii[kept] = radii[i];
+            paths[kept].swap(paths[i]);
+            slots.move(i, kept);
+
+            if (!levels.empty()) {
+                levels[kept] = levels[i];
+                halfSteps[kept] = halfSteps[i];
+            }
+        }
+
+        ++kept;
+    }
+
+    positions.resize(kept);
+    velocities.resize(kept);
+    masses.resize(kept);
+    radii.resize(kept);
+    paths.resize(kept);
+    slots.truncate(kept);
+
+    if (!levels.empty()) {
+        levels.resize(kept);
+        halfSteps.resize(kept);
+    }
+}
+
+void PlanetsUniverse::merge(const size_type& into, const size_type& other) {
+    /* Set the position and velocity to the wieghted average between the planets. */
+    positions[into] = positions[other] * masses[other] + positions[into] * masses[into];
+    velocities[into] = velocities[other] * masses[other] + velocities[into] * masses[into];
+
+    /* Add the masses together. */
+    masses[into] += masses[other];
+    radii[into] = Planet::radiusFromMass(masses[into]);
+
+    /* Finish the weighted average calculation. */
+    positions[into] /= masses[into];
+    velocities[into] /= masses[into];
+
+    /* The path would be invalid after this. */
+    paths[into].clear();
+}
+
+void PlanetsUniverse::drift(float time) {
+    PhaseTimer timer(phaseTimes.integration);
+
+    for (size_type i = 0; i < size(); ++i)
+        positions[i] += velocities[i] * time;
+}
+
+key_type PlanetsUniverse::addPlanet(const Planet& planet) {
+    positions.push_back(planet.position);
+    velocities.push_back(planet.velocity);
+    masses.push_back(planet.mass());
+    radii.push_back(planet.radius());
+    paths.emplace_back();
+    ++edits;
+
+    return slots.insert();
+}
+
+void PlanetsUniverse::remove(const key_type key, const key_type replacement) {
+    if (isValid(key))
+        removeAt(slots.index(key), replacement);
+}
+
+void PlanetsUniverse::removeAt(const size_type index, const key_type replacement) {
+    const key_type key = slots.key(index);
+    ++edits;
+
     /* If the one we're deleting happens to be selected, select the remaining planet. */
     if (key == selected)
         selected = replacement;
-    /* If the selected planet is after the one being deleted, it will shift down one location in the list. */
-    else if (key < selected)
-        --selected;
 
     /* If the planet being followed happens to be the one being deleted, follow the remaining planet. */
     if (key == following)
         following = replacement;
-    /* If the planet being followed is after the one being deleted, it will shift down one location in the list. */
-    else if (key < following)
-        --following;
 
-    planets.erase(begin() + key);
+    slots.release(index);
+
+    /* Fill the hole with the last planet, so nothing else has to move. */
+    const size_type last = size() - 1;
+
+    if (index != last) {
+        positions[index] = positions[last];
+        velocities[index] = velocities[last];
+        masses[index] = masses[last];
+        radii[index] = radii[last];
+        paths[index].swap(paths[last]);
+        slots.move(last, index);
+    }
+
+    positions.pop_back();
+    velocities.pop_back();
+    masses.pop_back();
+    radii.pop_back();
+    paths.pop_back();
+    slots.truncate(last);
+}
+
+void PlanetsUniverse::deleteAll() {
+    positions.clear();
+    velocities.clear();
+    masses.clear();
+    radii.clear();
+    paths.clear();
+    slots.clear();
+
+    /* The next universe won't have anything to do with the last sweep order. */
+    sweepOrder.clear();
+
+    resetSelected();
+    ++edits;
 }
 
 void PlanetsUniverse::generateRandom(const size_t& count, const float& positionRange, const float& maxVelocity, const float& maxMass) {
@@ -197,22 +1113,41 @@ void PlanetsUniverse::generateRandom(const size_t& count, const float& positionR
 
 /* TODO - This function currently does not account for other planets.
  * Doing so would be very complicated. IDK if it'd even be possible... I'll have to look into it sometime. */
-key_type PlanetsUniverse::addOrbital(Planet& around, const float& radius, const float& mass, const glm::mat4& plane) {
+key_type PlanetsUniverse::addOrbital(const key_type around, const float& radius, const float& mass, const glm::mat4& plane) {
+    if (!isValid(around))
+        throw std::out_of_range("Invalid planet key!");
+
+    /* Copy what we need, adding the new planet could move everything around. */
+    const size_type index = slots.index(around);
+    const glm::vec3 aroundPosition = positions[index];
+    const float aroundMass = masses[index];
+
     /* Calculate the speed based on gravitational force and distance. */
-    float speed = sqrt((around.mass() * around.mass() * gravityconst) / ((around.mass() + mass) * radius));
+    float speed = sqrt((aroundMass * aroundMass * gravityconst) / ((aroundMass + mass) * radius));
 
     /* Velocity is the y column of the plane matrix * speed. */
     glm::vec3 velocity = glm::vec3(plane[1]) * speed;
 
     /* The x column is the relative position of the orbiting planet. */
-    Planet planet(around.position + glm::vec3(plane[0]) * radius, around.velocity + velocity, mass);
+    Planet planet(aroundPosition + glm::vec3(plane[0]) * radius, velocities[index] + velocity, mass);
 
     /* Apply force on the planet being orbited in the opposite direction of the resulting planets velocity. */
-    around.velocity -= velocity * (mass / around.mass());
+    velocities[index] -= velocity * (mass / aroundMass);
 
     return addPlanet(planet);
 }
 
+/* A random unit vector from the generator, so randSeed() makes it repeat. */
+static glm::vec3 randomDirection(std::default_random_engine& generator) {
+    uniform_real_distribution<float> height(-1.0f, 1.0f);
+    uniform_real_distribution<float> angle(-glm::pi<float>(), glm::pi<float>());
+
+    const float z = height(generator);
+    const float a = angle(generator);
+    const float r = std::sqrt(1.0f - z * z);
+    return glm::vec3(r * std::cos(a), r * std::sin(a), z);
+}
+
 void PlanetsUniverse::generateRandomOrbital(const size_t& count, key_type target) {
     /* We need a planet to orbit around. */
     if (!isEmpty()) {
@@ -220,18 +1155,18 @@ void PlanetsUniverse::generateRandomOrbital(const size_t& count, key_type target
         if (!isValid(target))
             target = getRandomPlanet();
 
-        Planet &around = planets[target];
+        const size_type index = slots.index(target);
 
         uniform_real_distribution<float> angle(-glm::pi<float>(), glm::pi<float>());
-        uniform_real_distribution<float> radius(around.radius() * 1.5f, around.radius() * 80.0f);
-        uniform_real_distribution<float> mass(min_mass, around.mass() * 0.2f);
+        uniform_real_distribution<float> radius(radii[index] * 1.5f, radii[index] * 80.0f);
+        uniform_real_distribution<float> mass(min_mass, masses[index] * 0.2f);
 
         for (int i = 0; i < count; ++i) {
             glm::mat4 plane;
             /* This is sort of a cheap way of making a random orbit plane. */
-            plane *= glm::rotate(angle(generator), glm::sphericalRand(1.0f));
-            plane *= glm::rotate(angle(generator), glm::sphericalRand(1.0f));
-            addOrbital(around, radius(generator), mass(generator), plane);
+            plane *= glm::rotate(angle(generator), randomDirection(generator));
+            plane *= glm::rotate(angle(generator), randomDirection(generator));
+            addOrbital(target, radius(generator), mass(generator), plane);
         }
     }
 }
@@ -241,9 +1176,9 @@ void PlanetsUniverse::deleteEscapees() {
     glm::vec3 averagePosition;
     float totalMass = 0.0f;
 
-    for (const auto& planet : planets) {
-        averagePosition += planet.position * planet.mass();
-        totalMass += planet.mass();
+    for (size_type i = 0; i < size(); ++i) {
+        averagePosition += positions[i] * masses[i];
+        totalMass += masses[i];
     }
 
     averagePosition /= totalMass;
@@ -251,20 +1186,21 @@ void PlanetsUniverse::deleteEscapees() {
     /* The squared distance from the center outside of which we delete things. */
     const float limits2 = 1.0e12f;
 
-    for (int i = 0; i < size();) {
-        if (glm::distance2(planets[i].position, averagePosition) > limits2)
-            remove(i);
+    for (size_type i = 0; i < size();) {
+        /* Removing moves the last planet here, so check this spot again. */
+        if (glm::distance2(positions[i], averagePosition) > limits2)
+            removeAt(i, -1);
         else
             ++i;
     }
 }
 
 key_type PlanetsUniverse::getRandomPlanet() {
-    if (isEmpty()) return 0;
+    if (isEmpty()) return -1;
 
-    uniform_int_distribution<list_type::size_type> random_n(0, size() - 1);
+    uniform_int_distribution<size_type> random_n(0, size() - 1);
 
-    return random_n(generator);
+    return slots.key(random_n(generator));
 }
 
 void PlanetsUniverse::centerAll() {
@@ -272,10 +1208,10 @@ void PlanetsUniverse::centerAll() {
     glm::vec3 averagePosition, averageVelocity;
     float totalMass = 0.0f;
 
-    for (const auto& planet : planets) {
-        averagePosition += planet.position * planet.mass();
-        averageVelocity += planet.velocity * planet.mass();
-        totalMass += planet.mass();
+    for (size_type i = 0; i < size(); ++i) {
+        averagePosition += positions[i] * masses[i];
+        averageVelocity += velocities[i] * masses[i];
+        totalMass += masses[i];
     }
 
     averagePosition /= totalMass;
@@ -285,10 +1221,109 @@ void PlanetsUniverse::centerAll() {
 
     /* Don't bother centering if we're already reasonably centered. */
     if (!glm::isNull(averagePosition, epsilon) || !glm::isNull(averageVelocity, epsilon)) {
-        for (auto& planet : planets) {
-            planet.position -= averagePosition;
-            planet.velocity -= averageVelocity;
-            planet.path.clear();
+        for (size_type i = 0; i < size(); ++i) {
+            positions[i] -= averagePosition;
+            velocities[i] -= averageVelocity;
+            paths[i].clear();
+        }
+        ++edits;
+    }
+}
+
+void PlanetsUniverse::saveSnapshot(Snapshot& snapshot, bool withPaths) const {
+    snapshot.slots = slots;
+    snapshot.positions = positions;
+    snapshot.velocities = velocities;
+    snapshot.masses = masses;
+    snapshot.radii = radii;
+
+    if (withPaths)
+        snapshot.paths = paths;
+    else
+        snapshot.paths.clear();
+
+    if (canInterpolate())
+        snapshot.previousPositions = previousPositions;
+    else
+        snapshot.previousPositions.clear();
+    snapshot.interpolation = alpha;
+}
+
+void PlanetsUniverse::loadSnapshot(const Snapshot& snapshot, float time) {
+    /* The planets move without it counting as an edit. */
+    closingForces.valid = false;
+
+    if (snapshot.paths.size() == snapshot.positions.size()) {
+        paths = snapshot.paths;
+    } else {
+        /* Move each path to wherever its planet is now, anything new starts without one. A planet whose mass changed had
+         * something merged into it, which clears its path just like merging in advance() does. */
+        pathScratch.resize(snapshot.positions.size());
+
+        for (size_type i = 0; i < pathScratch.size(); ++i) {
+            const key_type key = snapshot.slots.key(i);
+
+            if (isValid(key) && masses[slots.index(key)] == snapshot.masses[i])
+                pathScratch[i].swap(paths[slots.index(key)]);
+            else
+                pathScratch[i].clear();
         }
+
+        paths.swap(pathScratch);
+    }
+
+    slots = snapshot.slots;
+    positions = snapshot.positions;
+    velocities = snapshot.velocities;
+    masses = snapshot.masses;
+    radii = snapshot.radii;
+
+    previousPositions = snapshot.previousPositions;
+    previousEdits = edits;
+    alpha = snapshot.interpolation;
+
+    if (time > 0.0f)
+        recordPaths(time, true);
+}
+
+PlanetsUniverse::ConservedQuantities PlanetsUniverse::conservedQuantities() const {
+    ConservedQuantities result = {};
+
+    /* Everything is added up in double precision, otherwise the rounding error would hide the error we're looking for. */
+    for (size_type i = 0; i < size(); ++i) {
+        const glm::dvec3 position(positions[i]), velocity(velocities[i]);
+        const double mass = masses[i];
+
+        result.energy += 0.5 * mass * glm::dot(velocity, velocity);
+        result.momentum += velocity * mass;
+        result.angularMomentum += glm::cross(position, velocity * mass);
+
+        for (size_type o = i + 1; o < size(); ++o)
+            result.energy -= double(gravityconst) * mass * masses[o] / glm::distance(position, glm::dvec3(positions[o]));
+    }
+
+    return result;
+}
+
+/* 64 bit FNV-1a, carrying on from hash. */
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
     }
+
+    return hash;
+}
+
+uint64_t PlanetsUniverse::stateHash() const {
+    const uint64_t count = size();
+
+    uint64_t hash = hashBytes(0xcbf29ce484222325ull, &count, sizeof(count));
+    hash = hashBytes(hash, positions.data(), positions.size() * sizeof(glm::vec3));
+    hash = hashBytes(hash, velocities.data(), velocities.size() * sizeof(glm::vec3));
+    hash = hashBytes(hash, masses.data(), masses.size() * sizeof(float));
+
+    return hash;
 }
@@ -0,0 +1,565 @@
+#include "recording.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+/* Recordings start with the magic and then the version and quantum. Each frame after that has a header of its own,
+ * then the coded bytes. Everything is little endian. */
+static const char recordingMagic[8] = { 'P', '3', 'D', 'R', 'E', 'C', '\r', '\n' };
+/* Version 2 has 64 bit keys. */
+static const uint32_t recordingVersion = 2;
+static const size_t fileHeaderSize = 16;
+/* Keyframe flag, planet count, time and the size of the coded bytes. */
+static const size_t frameHeaderSize = 1 + 4 + 8 + 4;
+
+const char* const RecordingPlayer::extension = ".p3r";
+
+static inline void put32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+        out.push_back(uint8_t(value >> (i * 8)));
+}
+
+static inline void put64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i)
+        out.push_back(uint8_t(value >> (i * 8)));
+}
+
+static inline uint32_t get32(const uint8_t* data) {
+    return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+}
+
+static inline uint64_t get64(const uint8_t* data) {
+    return uint64_t(get32(data)) | uint64_t(get32(data + 4)) << 32;
+}
+
+template <typename To, typename From> static inline To bitCast(const From& from) {
+    static_assert(sizeof(To) == sizeof(From), "Can only reinterpret things of the same size!");
+    To to;
+    std::memcpy(&to, &from, sizeof(To));
+    return to;
+}
+
+/* Small differences either way become small numbers. */
+static inline uint64_t zigzag(uint64_t value) {
+    return (value << 1) ^ (0 - (value >> 63));
+}
+
+static inline uint64_t unzigzag(uint64_t value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+/* The range coder is the same kind LZMA uses: binary decisions with adaptive probabilities out of 2048, and raw bits
+ * where there's nothing to predict. */
+static const uint32_t probabilityBits = 11;
+static const uint16_t probabilityHalf = 1 << (probabilityBits - 1);
+static const uint32_t adaptShift = 5;
+static const uint32_t rangeTop = 1 << 24;
+
+/* Numbers are stored as how many bits they have, which is coded with adaptive probabilities, then the bits themselves
+ * under the leading one. Each kind of number gets a model of its own, since they each have their own sizes. */
+struct NumberModel {
+    static const int lengthBits = 7;
+    uint16_t lengths[1 << lengthBits];
+
+    NumberModel() { std::fill(lengths, lengths + (1 << lengthBits), probabilityHalf); }
+};
+
+enum Model {
+    KeyModel,
+    PositionModel,
+    MassModel = PositionModel + 3,
+    ModelCount
+};
+
+class RangeEncoder {
+public:
+    explicit RangeEncoder(std::vector<uint8_t>& o) : out(o) { }
+
+    void bit(uint16_t& probability, uint32_t value) {
+        const uint32_t bound = (range >> probabilityBits) * probability;
+
+        if (value == 0) {
+            range = bound;
+            probability += ((1 << probabilityBits) - probability) >> adaptShift;
+        } else {
+            low += bound;
+            range -= bound;
+            probability -= probability >> adaptShift;
+        }
+
+        while (range < rangeTop) {
+            range <<= 8;
+            shiftLow();
+        }
+    }
+
+    void direct(uint64_t value, int bits) {
+        while (bits-- > 0) {
+            range >>= 1;
+            if ((value >> bits) & 1)
+                low += range;
+
+            while (range < rangeTop) {
+                range <<= 8;
+                shiftLow();
+            }
+        }
+    }
+
+    void number(NumberModel& model, uint64_t value) {
+        int length = 0;
+        while (length < 64 && (value >> length) != 0)
+            ++length;
+
+        uint32_t node = 1;
+        for (int i = NumberModel::lengthBits - 1; i >= 0; --i) {
+            const uint32_t b = (uint32_t(length) >> i) & 1;
+            bit(model.lengths[node], b);
+            node = (node << 1) | b;
+        }
+
+        if (length > 1)
+            direct(value, length - 1);
+    }
+
+    void finish() {
+        for (int i = 0; i < 5; ++i)
+            shiftLow();
+    }
+
+private:
+    std::vector<uint8_t>& out;
+    uint64_t low = 0;
+    uint32_t range = 0xffffffff;
+    uint8_t cache = 0;
+    uint64_t cacheSize = 1;
+
+    /* Bytes are held back until it's known whether a carry will still reach them. */
+    void shiftLow() {
+        if (uint32_t(low) < 0xff000000 || (low >> 32) != 0) {
+            const uint8_t carry = uint8_t(low >> 32);
+            uint8_t held = cache;
+            do {
+                out.push_back(uint8_t(held + carry));
+                held = 0xff;
+            } while (--cacheSize != 0);
+            cache = uint8_t(low >> 24);
+        }
+        ++cacheSize;
+        low = (low & 0x00ffffff) << 8;
+    }
+};
+
+class RangeDecoder {
+public:
+    RangeDecoder(const uint8_t* data, size_t size) : cursor(data), end(data + size) {
+        for (int i = 0; i < 5; ++i)
+            code = (code << 8) | next();
+    }
+
+    uint32_t bit(uint16_t& probability) {
+        const uint32_t bound = (range >> probabilityBits) * probability;
+        uint32_t value;
+
+        if (code < bound) {
+            range = bound;
+            probability += ((1 << probabilityBits) - probability) >> adaptShift;
+            value = 0;
+        } else {
+            code -= bound;
+            range -= bound;
+            probability -= probability >> adaptShift;
+            value = 1;
+        }
+
+        if (range < rangeTop) {
+            range <<= 8;
+            code = (code << 8) | next();
+        }
+
+        return value;
+    }
+
+    uint64_t direct(int bits) {
+        uint64_t value = 0;
+
+        while (bits-- > 0) {
+            range >>= 1;
+            uint64_t b = 0;
+            if (code >= range) {
+                code -= range;
+                b = 1;
+            }
+            value = (value << 1) | b;
+
+            if (range < rangeTop) {
+                range <<= 8;
+                code = (code << 8) | next();
+            }
+        }
+
+        return value;
+    }
+
+    uint64_t number(NumberModel& model) {
+        uint32_t node = 1;
+        for (int i = 0; i < NumberModel::lengthBits; ++i)
+            node = (node << 1) | bit(model.lengths[node]);
+
+        const int length = int(node - (1 << NumberModel::lengthBits));
+        if (length > 64)
+            throw std::runtime_error("Corrupt frame in recording!");
+        if (length <= 1)
+            return uint64_t(length);
+
+        return (uint64_t(1) << (length - 1)) | direct(length - 1);
+    }
+
+    /* Anything past the end reads as zeros, so a corrupt frame gives garbage instead of reading out of bounds. */
+    inline bool overran() const { return overrun > 0; }
+
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+    size_t overrun = 0;
+    uint32_t range = 0xffffffff;
+    uint32_t code = 0;
+
+    inline uint8_t next() {
+        if (cursor < end)
+            return *cursor++;
+
+        ++overrun;
+        return 0;
+    }
+};
+
+RecordingCodec::RecordingCodec(float quantum) : quantum_p(quantum) {
+    if (!(quantum > 0.0f) || !std::isfinite(quantum))
+        throw std::runtime_error("The quantum of a recording has to be more than 0!");
+}
+
+void RecordingCodec::beginFrame(const key_type* frameKeys, size_t count, bool keyframe) {
+    ++frame;
+    if (keyframe)
+        keyframeAt = frame;
+
+    key_type highest = 0;
+    for (size_t i = 0; i < count; ++i)
+        highest = std::max(highest, frameKeys[i] & SlotMap::slotMask);
+
+    if (count > 0 && tracks.size() <= highest)
+        tracks.resize(highest + 1);
+
+    quantized.resize(count * 3);
+}
+
+void RecordingCodec::predict(key_type key, int64_t* position, uint32_t& massBits) const {
+    const Track& track = tracks[key & SlotMap::slotMask];
+
+    /* Only frames since the last keyframe count, playback might not have seen anything before it. */
+    if (track.key != key || track.seen + 1 != frame || keyframeAt == frame) {
+        position[0] = position[1] = position[2] = 0;
+        massBits = 0;
+        return;
+    }
+
+    massBits = track.massBits;
+
+    if (track.seenBefore + 2 == frame && track.seenBefore >= keyframeAt) {
+        /* Keep going the same way, wrapping around instead of overflowing. */
+        for (int i = 0; i < 3; ++i)
+            position[i] = int64_t(2 * uint64_t(track.last[i]) - uint64_t(track.before[i]));
+    } else {
+        std::copy(track.last, track.last + 3, position);
+    }
+}
+
+void RecordingCodec::remember(key_type key, const int64_t* position, uint32_t massBits) {
+    Track& track = tracks[key & SlotMap::slotMask];
+
+    if (track.key == key && track.seen != 0) {
+        track.seenBefore = track.seen;
+        std::copy(track.last, track.last + 3, track.before);
+    } else {
+        track.seenBefore = 0;
+    }
+
+    track.key = key;
+    track.seen = frame;
+    std::copy(position, position + 3, track.last);
+    track.massBits = massBits;
+}
+
+void RecordingCodec::encode(const key_type* frameKeys, const glm::vec3* framePositions, const float* frameMasses, size_t count, bool keyframe, std::vector<uint8_t>& out) {
+    beginFrame(frameKeys, count, keyframe);
+
+    NumberModel models[ModelCount];
+    uint16_t sameKeys = probabilityHalf;
+    RangeEncoder encoder(out);
+
+    /* The planets are usually the same ones in the same order as last time. */
+    const bool same = !keyframe && count == keys.size() && std::equal(frameKeys, frameKeys + count, keys.begin());
+    encoder.bit(sameKeys, same ? 1 : 0);
+
+    if (!same)
+        for (size_t i = 0; i < count; ++i)
+            encoder.number(models[KeyModel], zigzag(uint64_t(frameKeys[i]) - uint64_t(i < keys.size() && !keyframe ? keys[i] : 0)));
+
+    const double scale = 1.0 / double(quantum_p);
+    /* Well short of where a double stops holding every integer. */
+    const double limit = 1.0e15;
+
+    for (size_t i = 0; i < count; ++i) {
+        int64_t* position = &quantized[i * 3];
+        for (int axis = 0; axis < 3; ++axis) {
+            const double value = double(framePositions[i][axis]) * scale;
+            /* Anything off the grid is pinned to its edge, and anything that isn't a number goes in the middle. */
+            position[axis] = std::isfinite(value) ? int64_t(std::llround(std::min(std::max(value, -limit), limit))) : 0;
+        }
+
+        int64_t predicted[3];
+        uint32_t previousMass;
+        predict(frameKeys[i], predicted, previousMass);
+
+        for (int axis = 0; axis < 3; ++axis)
+            encoder.number(models[PositionModel + axis], zigzag(uint64_t(position[axis]) - uint64_t(predicted[axis])));
+
+        /* Masses only change when planets merge, so this is nearly always 0. */
+        const uint32_t massBits = bitCast<uint32_t>(frameMasses[i]);
+        encoder.number(models[MassModel], massBits ^ previousMass);
+
+        remember(frameKeys[i], position, massBits);
+    }
+
+    encoder.finish();
+
+    keys.assign(frameKeys, frameKeys + count);
+    positions.resize(count);
+    masses.assign(frameMasses, frameMasses + count);
+    for (size_t i = 0; i < count; ++i)
+        for (int axis = 0; axis < 3; ++axis)
+            positions[i][axis] = float(double(quantized[i * 3 + axis]) * double(quantum_p));
+}
+
+void RecordingCodec::decode(const uint8_t* data, size_t size, size_t count, bool keyframe) {
+    NumberModel models[ModelCount];
+    uint16_t sameKeys = probabilityHalf;
+    RangeDecoder decoder(data, size);
+
+    const bool same = decoder.bit(sameKeys) != 0;
+    if (same && count != keys.size())
+        throw std::runtime_error("Corrupt frame in recording!");
+
+    if (!same) {
+        /* Each key comes from the one at the same place last frame, which is still needed until it's been read. The
+         * count comes from the file, so the keys only grow as they're actually read and a corrupt frame stops as soon
+         * as it runs out of data instead of allocating for a count it doesn't have. */
+        const size_t previous = keys.size();
+        for (size_t i = 0; i < count; ++i) {
+            const key_type key = key_type(unzigzag(decoder.number(models[KeyModel])) + (keyframe || i >= previous ? 0 : keys[i]));
+            if (decoder.overran())
+                throw std::runtime_error("Corrupt frame in recording!");
+
+            if (i < previous)
+                keys[i] = key;
+            else
+                keys.push_back(key);
+        }
+        keys.resize(count);
+    }
+
+    beginFrame(keys.data(), count, keyframe);
+    positions.resize(count);
+    masses.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (decoder.overran())
+            throw std::runtime_error("Corrupt frame in recording!");
+
+        int64_t predicted[3];
+        uint32_t previousMass;
+        predict(keys[i], predicted, previousMass);
+
+        int64_t* position = &quantized[i * 3];
+        for (int axis = 0; axis < 3; ++axis) {
+            position[axis] = int64_t(uint64_t(predicted[axis]) + unzigzag(decoder.number(models[PositionModel + axis])));
+            positions[i][axis] = float(double(position[axis]) * double(quantum_p));
+        }
+
+        const uint32_t massBits = uint32_t(decoder.number(models[MassModel])) ^ previousMass;
+        masses[i] = bitCast<float>(massBits);
+
+        remember(keys[i], position, massBits);
+    }
+
+    if (decoder.overran())
+        throw std::runtime_error("Corrupt frame in recording!");
+}
+
+Recorder::Recorder(const std::string& filename, float quantum) : file(filename, std::ios::binary | std::ios::trunc), codec(quantum) {
+    if (!file)
+        throw std::runtime_error("Unable to open \"" + filename + "\" for writing!");
+
+    buffer.assign(recordingMagic, recordingMagic + sizeof(recordingMagic));
+    put32(buffer, recordingVersion);
+    put32(buffer, bitCast<uint32_t>(quantum));
+
+    file.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+    written = buffer.size();
+}
+
+bool Recorder::record(const PlanetsUniverse& universe, double time) {
+    if (++calls < every)
+        return false;
+    calls = 0;
+
+    const bool keyframe = keyframeInterval <= 1 || frameCount % size_t(keyframeInterval) == 0;
+
+    keys.resize(universe.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        keys[i] = universe.keyAt(i);
+
+    /* The header is filled in once the size of the coded bytes is known. */
+    buffer.assign(frameHeaderSize, 0);
+    codec.encode(keys.data(), universe.positionData(), universe.massData(), keys.size(), keyframe, buffer);
+
+    std::vector<uint8_t> header;
+    header.push_back(keyframe ? 1 : 0);
+    put32(header, uint32_t(keys.size()));
+    put64(header, bitCast<uint64_t>(time));
+    put32(header, uint32_t(buffer.size() - frameHeaderSize));
+    std::copy(header.begin(), header.end(), buffer.begin());
+
+    file.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+    if (!file)
+        throw std::runtime_error("Unable to write to the recording!");
+
+    written += buffer.size();
+    ++frameCount;
+    return true;
+}
+
+void Recorder::flush() {
+    file.flush();
+}
+
+RecordingPlayer::RecordingPlayer(const std::string& filename) : file(filename), codec(1.0f), current(0), shownFrame(0) {
+    if (!file.isOpen())
+        throw std::runtime_error("Unable to open \"" + filename + "\"!");
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+
+    if (file.size() < fileHeaderSize || std::memcmp(data, recordingMagic, sizeof(recordingMagic)) != 0)
+        throw std::runtime_error("\"" + filename + "\" isn't a recording!");
+
+    if (get32(data + 8) != recordingVersion)
+        throw std::runtime_error("\"" + filename + "\" was recorded by a different version!");
+
+    codec = RecordingCodec(bitCast<float>(get32(data + 12)));
+
+    /* Only the headers are read now, each frame is decoded when it's needed. */
+    for (size_t offset = fileHeaderSize; file.size() - offset >= frameHeaderSize;) {
+        Frame frame;
+        frame.keyframe = data[offset] != 0;
+        frame.count = get32(data + offset + 1);
+        frame.time = bitCast<double>(get64(data + offset + 5));
+        frame.size = get32(data + offset + 13);
+        frame.offset = offset + frameHeaderSize;
+
+        if (file.size() - frame.offset < frame.size)
+            break;
+
+        /* No universe can hold more than this, so anything bigger can only be a corrupt header. */
+        if (frame.count > SlotMap::maxSize)
+            throw std::runtime_error("\"" + filename + "\" is corrupt!");
+
+        if (index.empty() && !frame.keyframe)
+            throw std::runtime_error("\"" + filename + "\" doesn't start with a keyframe!");
+
+        index.push_back(frame);
+        offset = frame.offset + frame.size;
+    }
+
+    current = shownFrame = index.size();
+}
+
+void RecordingPlayer::decode(size_t frame) {
+    /* If this fails the codec is left half way through a frame, so the next seek has to start again from a keyframe. */
+    current = index.size();
+
+    const Frame& info = index[frame];
+    codec.decode(reinterpret_cast<const uint8_t*>(file.data()) + info.offset, info.size, info.count, info.keyframe);
+    current = frame;
+}
+
+void RecordingPlayer::seek(size_t frame) {
+    if (frame >= index.size())
+        throw std::out_of_range("There's no such frame in the recording!");
+
+    if (frame == current)
+        return;
+
+    size_t start = frame;
+    while (!index[start].keyframe)
+        --start;
+
+    /* Going forwards from the current frame is quicker unless there's a keyframe on the way. */
+    const bool forwards = current < index.size() && current < frame;
+    if (forwards && start <= current)
+        start = current + 1;
+    if (!forwards)
+        jumped = true;
+
+    for (size_t i = start; i <= frame; ++i)
+        decode(i);
+}
+
+void RecordingPlayer::show(PlanetsUniverse& universe) {
+    if (current >= index.size())
+        return;
+
+    const bool following = !jumped && shownFrame < current;
+    const float cosine = std::cos(universe.pathRecordAngle);
+
+    std::unordered_map<key_type, key_type> next;
+    next.reserve(codec.keys.size());
+
+    for (size_t i = 0; i < codec.keys.size(); ++i) {
+        std::unordered_map<key_type, key_type>::iterator found = shown.find(codec.keys[i]);
+        key_type key;
+
+        if (found != shown.end() && universe.isValid(found->second)) {
+            key = found->second;
+            shown.erase(found);
+
+            PlanetRef planet = universe[key];
+            planet.position = codec.positions[i];
+            planet.velocity = glm::vec3();
+            if (planet.mass() != codec.masses[i])
+                planet.setMass(codec.masses[i]);
+
+            if (!following)
+                planet.path.clear();
+            else if (universe.pathLength > 0)
+                updatePath(planet.path, planet.position, universe.pathLength, universe.pathRecordDistance, cosine);
+        } else {
+            key = universe.addPlanet(Planet(codec.positions[i], glm::vec3(), codec.masses[i]));
+        }
+
+        next[codec.keys[i]] = key;
+    }
+
+    /* Whatever is left has merged into something else since the last frame that was shown. */
+    for (std::unordered_map<key_type, key_type>::const_iterator i = shown.begin(); i != shown.end(); ++i)
+        if (universe.isValid(i->second))
+            universe.remove(i->second);
+
+    shown.swap(next);
+    shownFrame = current;
+    jumped = false;
+
+    /* The planets jumped, there's nothing to interpolate from. */
+    universe.edited();
+}
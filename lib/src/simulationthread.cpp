@@ -0,0 +1,239 @@
+#include "simulationthread.h"
+#include <algorithm>
+#include <memory>
+
+typedef std::chrono::steady_clock Clock;
+
+/* Real time between two points in microseconds, which is what advance() takes. Never more than a second, so one long pause
+ * doesn't turn into one huge step. */
+static int elapsedMicroseconds(Clock::time_point from, Clock::time_point to) {
+    const long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+    return int(std::min(elapsed, 1000000LL));
+}
+
+SimulationThread::SimulationThread() : running(false), latest(0), stepCount(0), lastStepTime(0.0f) { }
+
+SimulationThread::~SimulationThread() {
+    stop();
+}
+
+void SimulationThread::start(const PlanetsUniverse& universe) {
+    stop();
+
+    PlanetsUniverse::Snapshot snapshot;
+    universe.saveSnapshot(snapshot);
+    simulation.deleteAll();
+    simulation.loadSnapshot(snapshot);
+
+    /* The UI records the paths. */
+    simulation.pathLength = 0;
+
+    simulation.selected = simulation.following = -1;
+    selectedFrom = followingFrom = -1;
+
+    /* Anything left in the buffers from before is from an older generation, so the UI won't load it. */
+    simulationGeneration = ++generation;
+    simulatedTime = 0.0;
+    syncedTime = 0.0;
+    syncedEdits = universe.editCount();
+
+    latest = 0;
+    back = 1;
+    front = 2;
+
+    commands.clear();
+    settings = {};
+    quit = false;
+    running = true;
+
+#ifdef EMSCRIPTEN
+    lastSync = Clock::now();
+#else
+    worker = std::thread(&SimulationThread::run, this);
+#endif
+}
+
+void SimulationThread::stop() {
+    if (!running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+
+    if (worker.joinable())
+        worker.join();
+
+    running = false;
+}
+
+void SimulationThread::post(const Command& command) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        commands.push_back(command);
+    }
+    wake.notify_one();
+}
+
+bool SimulationThread::sync(PlanetsUniverse& universe, bool advancing) {
+    if (!running)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        settings.simspeed = universe.simspeed;
+        settings.stepsPerFrame = universe.stepsPerFrame;
+        settings.fixedTimestep = universe.fixedTimestep;
+        settings.fixedStep = universe.fixedStep;
+        settings.maxFixedSteps = universe.maxFixedSteps;
+        settings.forceBackend = universe.forceBackend;
+        settings.barnesHutTheta = universe.barnesHutTheta;
+        settings.multipoleOrder = universe.multipoleOrder;
+        settings.multipoleTheta = universe.multipoleTheta;
+        settings.integrator = universe.integrator;
+        settings.instructionSet = universe.instructionSet;
+        settings.threadCount = universe.threadCount;
+        settings.deterministic = universe.deterministic;
+        settings.timestepLevels = universe.timestepLevels;
+        settings.timestepAccuracy = universe.timestepAccuracy;
+        settings.selected = universe.selected;
+        settings.following = universe.following;
+        settings.advancing = advancing;
+    }
+    wake.notify_one();
+
+    if (universe.editCount() != syncedEdits) {
+        /* The UI's planets win, so the keys it handed out stay valid. Whatever the simulation did since the snapshot
+         * the edit was made on gets dropped, it was never shown anyway. */
+        syncedEdits = universe.editCount();
+        const uint64_t replacement = ++generation;
+
+        std::shared_ptr<PlanetsUniverse::Snapshot> snapshot = std::make_shared<PlanetsUniverse::Snapshot>();
+        universe.saveSnapshot(*snapshot);
+
+        post([this, snapshot, replacement](PlanetsUniverse& simulation) {
+            simulation.loadSnapshot(*snapshot);
+            simulationGeneration = replacement;
+
+            /* Take the UI's selection again too, whatever the simulation moved it to was in planets that are gone now. */
+            selectedFrom = followingFrom = -1;
+        });
+    }
+
+#ifdef EMSCRIPTEN
+    const Clock::time_point now = Clock::now();
+    step(elapsedMicroseconds(lastSync, now));
+    lastSync = now;
+#endif
+
+    if ((latest.load() & fresh) == 0)
+        return false;
+
+    front = latest.exchange(front) & ~fresh;
+    const Buffer& buffer = buffers[front];
+
+    /* From before the last edit, the UI's own planets are newer. */
+    if (buffer.generation != generation)
+        return false;
+
+    universe.loadSnapshot(buffer.snapshot, float(buffer.time - syncedTime));
+    syncedTime = buffer.time;
+
+    /* Go where the simulation went when it merged away the selected or followed planet, like advance() would. Only if the UI
+     * hasn't picked something else since. */
+    if (!universe.isValid(universe.selected) && universe.selected == buffer.selectedFrom)
+        universe.selected = buffer.selected;
+    if (!universe.isValid(universe.following) && universe.following == buffer.followingFrom)
+        universe.following = buffer.following;
+
+    return true;
+}
+
+void SimulationThread::step(int delay) {
+    std::vector<Command> pending;
+    Settings current;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.swap(commands);
+        current = settings;
+    }
+
+    for (const Command& command : pending)
+        command(simulation);
+
+    simulation.simspeed = current.simspeed;
+    simulation.stepsPerFrame = current.stepsPerFrame;
+    simulation.fixedTimestep = current.fixedTimestep;
+    simulation.fixedStep = current.fixedStep;
+    simulation.maxFixedSteps = current.maxFixedSteps;
+    simulation.forceBackend = current.forceBackend;
+    simulation.barnesHutTheta = current.barnesHutTheta;
+    simulation.multipoleOrder = current.multipoleOrder;
+    simulation.multipoleTheta = current.multipoleTheta;
+    simulation.integrator = current.integrator;
+    simulation.instructionSet = current.instructionSet;
+    simulation.threadCount = current.threadCount;
+    simulation.deterministic = current.deterministic;
+    simulation.timestepLevels = current.timestepLevels;
+    simulation.timestepAccuracy = current.timestepAccuracy;
+
+    /* Only taken when the UI picks something else, otherwise it would undo advance() moving them on from a merged planet. */
+    if (current.selected != selectedFrom)
+        simulation.selected = selectedFrom = current.selected;
+    if (current.following != followingFrom)
+        simulation.following = followingFrom = current.following;
+
+    if (current.advancing && delay > 0) {
+        const Clock::time_point start = Clock::now();
+        simulation.advance(float(delay));
+        lastStepTime = std::chrono::duration<float>(Clock::now() - start).count();
+        ++stepCount;
+
+        simulatedTime += double(delay) * current.simspeed;
+    }
+
+    Buffer& buffer = buffers[back];
+    simulation.saveSnapshot(buffer.snapshot);
+    buffer.generation = simulationGeneration;
+    buffer.time = simulatedTime;
+    buffer.selected = simulation.selected;
+    buffer.following = simulation.following;
+    buffer.selectedFrom = selectedFrom;
+    buffer.followingFrom = followingFrom;
+
+    back = latest.exchange(back | fresh) & ~fresh;
+}
+
+void SimulationThread::run() {
+    /* Tiny universes would otherwise publish snapshots far faster than anything could draw them. */
+    const Clock::duration minimumStep = std::chrono::milliseconds(1);
+
+    Clock::time_point last = Clock::now();
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            /* Sleep while held still, until the UI sends something. */
+            wake.wait(lock, [this] { return quit || settings.advancing || !commands.empty(); });
+
+            if (quit)
+                return;
+
+            /* The time spent held still shouldn't be simulated afterwards. */
+            if (!settings.advancing)
+                last = Clock::now();
+        }
+
+        const Clock::time_point now = Clock::now();
+        step(elapsedMicroseconds(last, now));
+        last = now;
+
+        const Clock::duration spent = Clock::now() - now;
+        if (spent < minimumStep)
+            std::this_thread::sleep_for(minimumStep - spent);
+    }
+}
@@ -0,0 +1,55 @@
+#include "slotmap.h"
+#include <stdexcept>
+
+key_type SlotMap::insert() {
+    key_type slot;
+
+    if (!freeSlots.empty()) {
+        slot = freeSlots.front();
+        freeSlots.pop_front();
+    } else {
+        if (slots.size() >= maxSize)
+            throw std::length_error("Too many planets!");
+
+        slot = key_type(slots.size());
+        slots.push_back(slot);
+        indices.push_back(0);
+    }
+
+    indices[slot] = keys.size();
+    keys.push_back(slots[slot]);
+
+    return slots[slot];
+}
+
+void SlotMap::release(size_t index) {
+    const key_type slot = keys[index] & slotMask;
+
+    /* Retire the slot once its generation would wrap around to one that might still be in use. -1 can't match
+     * any key for this slot, since it has every slot bit set. */
+    if ((slots[slot] >> slotBits) == (key_type(-1) >> slotBits)) {
+        slots[slot] = key_type(-1);
+        return;
+    }
+
+    slots[slot] += key_type(1) << slotBits;
+
+    freeSlots.push_back(slot);
+}
+
+void SlotMap::move(size_t from, size_t to) {
+    keys[to] = keys[from];
+    indices[keys[to] & slotMask] = to;
+}
+
+void SlotMap::truncate(size_t size) {
+    keys.resize(size);
+}
+
+void SlotMap::clear() {
+    /* Release everything instead of starting over, so old keys don't become valid again. */
+    for (size_t i = 0; i < keys.size(); ++i)
+        release(i);
+
+    keys.clear();
+}
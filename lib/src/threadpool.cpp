@@ -0,0 +1,95 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool() { }
+
+ThreadPool::~ThreadPool() {
+    resize(1);
+}
+
+void ThreadPool::resize(unsigned int threads) {
+#ifdef EMSCRIPTEN
+    threads = 1;
+#endif
+
+    if (threads < 1)
+        threads = 1;
+
+    if (threads == count)
+        return;
+
+    /* Stop all the old workers, it's simpler than only changing some of them. */
+    if (!workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        started.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+
+        workers.clear();
+        quit = false;
+    }
+
+    count = threads;
+
+    /* Thread 0 is whoever calls run(). */
+    for (unsigned int t = 1; t < count; ++t)
+        workers.emplace_back(&ThreadPool::work, this, t, generation);
+}
+
+void ThreadPool::run(size_t tasks, const Job& job) {
+    if (workers.empty()) {
+        for (size_t t = 0; t < tasks; ++t)
+            job(t, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->tasks = tasks;
+        remaining = unsigned(workers.size());
+        ++generation;
+    }
+    started.notify_all();
+
+    for (size_t t = 0; t < tasks; t += count)
+        job(t, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return remaining == 0; });
+}
+
+void ThreadPool::work(unsigned int thread, unsigned int seen) {
+    for (;;) {
+        const Job* job;
+        size_t tasks;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [this, seen] { return quit || generation != seen; });
+
+            if (quit)
+                return;
+
+            seen = generation;
+            job = this->job;
+            tasks = this->tasks;
+        }
+
+        for (size_t t = thread; t < tasks; t += count)
+            (*job)(t, thread);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--remaining == 0)
+            finished.notify_one();
+    }
+}
+
+unsigned int ThreadPool::hardwareThreads() {
+    /* This is allowed to return 0 if it can't tell. */
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
@@ -0,0 +1,43 @@
+#include "trail.h"
+
+void Trail::push_back(const glm::vec3& point) {
+    if (length == 0)
+        return;
+
+    if (count < length) {
+        /* Still filling up, so the points haven't wrapped around yet. */
+        points.push_back(point);
+        changed(count, count + 1);
+        ++count;
+        return;
+    }
+
+    /* Full, make room for the copy of the first point the first time around. */
+    if (points.size() == length) {
+        points.push_back(points[0]);
+        changed(length, length + 1);
+    }
+
+    /* Overwrite the oldest point, the one after it becomes the oldest. */
+    set(first, point);
+    first = wrap(first + 1);
+}
+
+void Trail::resize(size_t capacity) {
+    /* Keep the newest points, starting the buffer over from 0. */
+    const size_t kept = std::min(count, capacity);
+    std::vector<glm::vec3> newPoints;
+    newPoints.reserve(kept);
+
+    for (size_t i = count - kept; i < count; ++i)
+        newPoints.push_back((*this)[i]);
+
+    points.swap(newPoints);
+    first = 0;
+    count = kept;
+    length = capacity;
+
+    /* Everything moved. */
+    changedBegin = 0;
+    changedEnd = count;
+}
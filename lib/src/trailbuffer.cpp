@@ -0,0 +1,50 @@
+#include "trailbuffer.h"
+#include <algorithm>
+
+bool TrailBuffer::update(PlanetsUniverse& universe) {
+    uploads.clear();
+    firsts.clear();
+    counts.clear();
+
+    /* A trail needs one more vertex than its capacity, for the copy of its first point. */
+    size_t neededStride = 0;
+    size_t neededSlots = 0;
+    for (auto i = universe.begin(); i != universe.end(); ++i) {
+        neededStride = std::max(neededStride, i->path.capacity() + 1);
+        neededSlots = std::max(neededSlots, size_t(i.key() & SlotMap::slotMask) + 1);
+    }
+
+    /* Grow with some room to spare, so adding planets doesn't mean starting over every time. */
+    const bool reallocate = neededStride > stride || neededSlots > uploaded.size();
+    if (reallocate) {
+        stride = std::max(stride, neededStride);
+        uploaded.assign(std::max(neededSlots, uploaded.size() * 2), key_type(-1));
+    }
+
+    Trail::Span spans[2];
+    for (auto i = universe.begin(); i != universe.end(); ++i) {
+        Trail& path = i->path;
+        const key_type key = i.key();
+        const size_t offset = (key & SlotMap::slotMask) * stride;
+
+        size_t begin, end;
+        path.takeChanges(begin, end);
+
+        /* A new planet in the slot, or a new buffer, needs the whole trail. */
+        if (uploaded[key & SlotMap::slotMask] != key) {
+            uploaded[key & SlotMap::slotMask] = key;
+            begin = 0;
+            end = path.dataSize();
+        }
+
+        if (begin < end)
+            uploads.push_back(Upload{ offset + begin, path.data() + begin, end - begin });
+
+        for (size_t s = 0, count = path.spans(spans); s < count; ++s) {
+            firsts.push_back(int(offset + (spans[s].data - path.data())));
+            counts.push_back(int(spans[s].size));
+        }
+    }
+
+    return reallocate;
+}
@@ -0,0 +1,232 @@
+#include "xmlreader.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+static inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool isNameEnd(char c) {
+    return isWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '<';
+}
+
+/* Add a character code to a string as UTF-8. */
+static void appendUTF8(std::string& into, unsigned long code) {
+    if (code < 0x80) {
+        into += char(code);
+    } else if (code < 0x800) {
+        into += char(0xc0 | (code >> 6));
+        into += char(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+        into += char(0xe0 | (code >> 12));
+        into += char(0x80 | ((code >> 6) & 0x3f));
+        into += char(0x80 | (code & 0x3f));
+    } else {
+        into += char(0xf0 | (code >> 18));
+        into += char(0x80 | ((code >> 12) & 0x3f));
+        into += char(0x80 | ((code >> 6) & 0x3f));
+        into += char(0x80 | (code & 0x3f));
+    }
+}
+
+XmlReader::XmlReader(const char* data, size_t size) : begin(data), end(data + size), cursor(data) {
+    /* Skip a UTF-8 byte order mark. */
+    if (size >= 3 && std::memcmp(data, "\xef\xbb\xbf", 3) == 0)
+        cursor += 3;
+}
+
+XmlReader::Event XmlReader::next() {
+    if (pendingEnd) {
+        pendingEnd = false;
+        return EndElement;
+    }
+
+    attributeCount = 0;
+
+    for (;;) {
+        /* Anything up to the next tag is text, which nothing needs. */
+        cursor = std::find(cursor, end, '<');
+
+        if (cursor == end) {
+            if (!open.empty())
+                fail("The file ended before <" + open.back() + "> was closed.");
+
+            eventDepth = 0;
+            return EndDocument;
+        }
+
+        const size_t left = size_t(end - cursor);
+
+        if (left >= 2 && cursor[1] == '?') {
+            skipPast("?>", "a processing instruction");
+        } else if (left >= 4 && std::memcmp(cursor, "<!--", 4) == 0) {
+            skipPast("-->", "a comment");
+        } else if (left >= 9 && std::memcmp(cursor, "<![CDATA[", 9) == 0) {
+            skipPast("]]>", "a CDATA section");
+        } else if (left >= 2 && cursor[1] == '!') {
+            /* A doctype, which can have declarations in brackets with more tags inside them. */
+            int brackets = 0;
+            for (++cursor; cursor < end && (brackets > 0 || *cursor != '>'); ++cursor) {
+                if (*cursor == '[')
+                    ++brackets;
+                else if (*cursor == ']')
+                    --brackets;
+            }
+            if (cursor == end)
+                fail("The file ended inside a doctype.");
+            ++cursor;
+        } else if (left >= 2 && cursor[1] == '/') {
+            cursor += 2;
+            readName(elementName);
+            skipWhitespace();
+
+            if (cursor == end || *cursor != '>')
+                fail("Expected > to end </" + elementName + ">.");
+            ++cursor;
+
+            if (open.empty() || open.back() != elementName)
+                fail("</" + elementName + "> doesn't match " + (open.empty() ? std::string("any open element") : "<" + open.back() + ">") + ".");
+
+            eventDepth = open.size();
+            open.pop_back();
+            return EndElement;
+        } else {
+            ++cursor;
+            readName(elementName);
+
+            for (;;) {
+                skipWhitespace();
+
+                if (cursor == end)
+                    fail("The file ended inside <" + elementName + ">.");
+
+                if (*cursor == '>') {
+                    ++cursor;
+                    break;
+                }
+
+                if (*cursor == '/') {
+                    if (cursor + 1 == end || cursor[1] != '>')
+                        fail("Expected /> to end <" + elementName + ">.");
+                    cursor += 2;
+                    pendingEnd = true;
+                    break;
+                }
+
+                if (attributeCount == attributes.size())
+                    attributes.emplace_back();
+                std::pair<std::string, std::string>& attribute = attributes[attributeCount++];
+
+                readName(attribute.first);
+                skipWhitespace();
+                if (cursor == end || *cursor != '=')
+                    fail("Expected = after " + attribute.first + " in <" + elementName + ">.");
+                ++cursor;
+                skipWhitespace();
+                readValue(attribute.second);
+            }
+
+            /* An empty element is closed again straight away. */
+            eventDepth = open.size() + 1;
+            if (!pendingEnd)
+                open.push_back(elementName);
+
+            return StartElement;
+        }
+    }
+}
+
+const std::string* XmlReader::attribute(const char* name) const {
+    for (size_t i = 0; i < attributeCount; ++i)
+        if (attributes[i].first == name)
+            return &attributes[i].second;
+
+    return nullptr;
+}
+
+void XmlReader::fail(const std::string& message) const {
+    const size_t line = size_t(std::count(begin, cursor, '\n')) + 1;
+    throw std::runtime_error("Line " + std::to_string(line) + ": " + message);
+}
+
+void XmlReader::skipPast(const char* terminator, const char* description) {
+    const size_t length = std::strlen(terminator);
+    const char* found = std::search(cursor, end, terminator, terminator + length);
+
+    if (found == end)
+        fail(std::string("The file ended inside ") + description + ".");
+
+    cursor = found + length;
+}
+
+void XmlReader::skipWhitespace() {
+    while (cursor < end && isWhitespace(*cursor))
+        ++cursor;
+}
+
+void XmlReader::readName(std::string& into) {
+    const char* start = cursor;
+    while (cursor < end && !isNameEnd(*cursor))
+        ++cursor;
+
+    if (cursor == start)
+        fail("Expected a name.");
+
+    into.assign(start, cursor);
+}
+
+void XmlReader::readValue(std::string& into) {
+    if (cursor == end || (*cursor != '"' && *cursor != '\''))
+        fail("Expected a quoted value in <" + elementName + ">.");
+
+    const char quote = *cursor++;
+    const char* close = std::find(cursor, end, quote);
+    if (close == end)
+        fail("The file ended inside a value in <" + elementName + ">.");
+
+    into.clear();
+
+    /* Most values don't have any entities, so copy everything up to each one in one go. */
+    while (cursor < close) {
+        const char* amp = std::find(cursor, close, '&');
+        into.append(cursor, amp);
+        cursor = amp;
+
+        if (cursor == close)
+            break;
+
+        const char* semicolon = std::find(cursor, close, ';');
+        const std::string entity(cursor + 1, semicolon);
+
+        if (semicolon == close) {
+            /* Not really an entity, keep it as it is. */
+            into += '&';
+            ++cursor;
+            continue;
+        }
+
+        if (entity == "amp")
+            into += '&';
+        else if (entity == "lt")
+            into += '<';
+        else if (entity == "gt")
+            into += '>';
+        else if (entity == "quot")
+            into += '"';
+        else if (entity == "apos")
+            into += '\'';
+        else if (entity.size() > 1 && entity[0] == '#')
+            appendUTF8(into, entity[1] == 'x' ? std::strtoul(entity.c_str() + 2, nullptr, 16) : std::strtoul(entity.c_str() + 1, nullptr, 10));
+        else {
+            into += '&';
+            ++cursor;
+            continue;
+        }
+
+        cursor = semicolon + 1;
+    }
+
+    cursor = close + 1;
+}
@@ -1,9 +1,11 @@
 #pragma once
 
+#include "backgroundsaver.h"
 #include <QMainWindow>
 #include <QSettings>
 
 class QLabel;
+class QSlider;
 
 namespace Ui {
 class MainWindow;
@@ -31,6 +33,12 @@ private slots:
     bool on_actionSave_Simulation_triggered();
     void on_actionAbout_triggered();
 
+    void on_actionRecord_Simulation_toggled(bool value);
+    void on_actionOpen_Recording_triggered();
+    void on_actionPlay_Recording_toggled(bool value);
+    void on_actionClose_Recording_triggered();
+    void playbackSliderMoved(int value);
+
     void on_stepsPerFrameSpinBox_valueChanged(int value);
     void on_trailLengthSpinBox_valueChanged(int value);
     void on_trailRecordDistanceDoubleSpinBox_valueChanged(double value);
@@ -43,6 +51,7 @@ private slots:
     void on_actionDraw_Paths_toggled(bool value);
     void on_actionHide_Planets_toggled(bool value);
     void on_actionDraw_Planar_Circles_toggled(bool value);
+    void on_actionSphere_Impostors_toggled(bool value);
 
     void on_randomOrbitalCheckBox_toggled(bool checked);
     void on_generateRandomPushButton_clicked();
@@ -66,6 +75,9 @@ private:
     const static QString settingTrailLength;
     const static QString settingTrailDelta;
     const static QString settingStepsPerFrame;
+    const static QString categoryAutosave;
+    const static QString settingAutosaveInterval;
+    const static QString settingAutosaveCount;
 
     Ui::MainWindow* ui;
 
@@ -75,11 +87,31 @@ private:
 
     QSettings settings;
 
+    /* Writes saves and autosaves without stopping everything else. */
+    BackgroundSaver saver;
+
+    /* Show how any saves that finished went. Returns false if any of them failed. */
+    bool showSaveResults();
+
     /* These labels go in the statusbar. */
     QLabel* planetCountLabel;
     QLabel* fpsLabel;
     QLabel* averagefpsLabel;
 
+    /* Load a file with a progress dialog, then show how it went. Returns false if it failed or was cancelled.
+     * Recordings are played back instead. */
+    bool loadSimulation(const QString& filename, bool clear);
+
+    /* Start playing back a recording, showing an error and returning false if it can't be. */
+    bool openRecording(const QString& filename);
+
+    /* Goes in the playback toolbar, with the time next to it. */
+    QSlider* playbackSlider;
+    QLabel* playbackLabel;
+
+    /* Make the playback toolbar and record action match what the widget is doing. */
+    void updatePlayback();
+
     /* Read recent file list from settings. */
     QStringList getRecentFiles();
 
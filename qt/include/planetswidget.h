@@ -4,10 +4,15 @@
 #include "planetsuniverse.h"
 #include "spheregenerator.h"
 #include "grid.h"
+#include "trailbuffer.h"
+#include "planetinstances.h"
+#include "simulationthread.h"
+#include "recording.h"
 #include "camera.h"
 #include <QElapsedTimer>
 #include <QTimer>
 #include <QDir>
+#include <memory>
 
 class QMouseEvent;
 
@@ -28,12 +33,16 @@ private:
     QOpenGLShaderProgram shaderTexture;
     int shaderTexture_cameraMatrix, shaderTexture_viewMatrix, shaderTexture_modelMatrix, shaderTexture_lightDir;
 
+    /* GL shader and uniform handles for the sphere impostor shader. */
+    QOpenGLShaderProgram shaderImpostor;
+    int shaderImpostor_cameraMatrix, shaderImpostor_viewMatrix, shaderImpostor_eye, shaderImpostor_up, shaderImpostor_lightDir;
+
     /* GL shader and uniform handles for color shader. */
     QOpenGLShaderProgram shaderColor;
     int shaderColor_cameraMatrix, shaderColor_modelMatrix, shaderColor_color;
 
     /* GL vertex attribute handles. */
-    const static int vertex, normal, tangent, uv;
+    const static int vertex, normal, tangent, uv, instance;
 
     QOpenGLTexture* texture_diff;
     QOpenGLTexture* texture_nrm;
@@ -53,9 +62,10 @@ private:
     /* The position of the mouse cursor last mouse movement event. */
     QPoint lastMousePos;
 
-    QOpenGLBuffer highResSphereVerts;
-    QOpenGLBuffer highResSphereTris;
-    unsigned int highResSphereTriCount;
+    /* Every level of detail for planets, see SphereLevels. */
+    QOpenGLBuffer planetSphereVerts;
+    QOpenGLBuffer planetSphereIndices;
+    uint32_t planetIndexStart[SphereLevels::levels + 1];
 
     QOpenGLBuffer lowResSphereVerts;
     QOpenGLBuffer lowResSphereLines;
@@ -65,6 +75,20 @@ private:
     QOpenGLBuffer circleLines;
     unsigned int circleLineCount;
 
+    /* The position, radius, and level of detail of every planet, so they can be drawn with one call per level.
+     * Needs OpenGL 3.3 or OpenGL ES 3. */
+    bool instancing = false;
+    QOpenGLBuffer instanceVerts;
+    PlanetInstances planetInstances;
+
+    /* Can planets be drawn as impostors? They need instancing, and OpenGL ES needs GL_EXT_frag_depth. */
+    bool impostors = false;
+    QOpenGLBuffer impostorVerts;
+
+    /* Every trail lives in this one buffer, only the points that changed get uploaded each frame. */
+    QOpenGLBuffer trailVerts;
+    TrailBuffer trailBuffer;
+
     const static QColor trailColor;
 
 #ifdef PLANETS3D_QT_USE_SDL_GAMEPAD
@@ -75,6 +99,23 @@ public:
     PlanetsWidget(QWidget *parent = nullptr);
 
     PlanetsUniverse universe;
+    /* Advances the universe on its own thread, universe is the latest snapshot of it. */
+    SimulationThread simulation;
+
+    /* Records every snapshot from the simulation while set. */
+    std::unique_ptr<Recorder> recorder;
+
+    /* Plays a recording back instead of simulating while set. The time is in simulated seconds, and goes at the sim speed. */
+    std::unique_ptr<RecordingPlayer> player;
+    bool playing = false;
+    double playbackTime = 0.0;
+
+    /* Stop simulating and play a recording instead. Throws std::runtime_error if it can't be read. */
+    void openRecording(const std::string& filename);
+    /* Go back to simulating, starting with an empty universe. */
+    void closeRecording();
+    /* Jump to a frame of the recording, setting the playback time to it. Closes the recording if it can't be read. */
+    void showFrame(size_t frame);
 
     PlacingInterface placing;
 
@@ -88,6 +129,8 @@ public:
     bool drawPlanarCircles = false;
     /* Do we hide the textured planet spheres? */
     bool hidePlanets = false;
+    /* Draw planets as one quad each with the sphere traced in the fragment shader, where the context can. */
+    bool drawImpostors = false;
 
     /* Where we save screenshots to. */
     QDir screenshotDir;
@@ -124,6 +167,11 @@ protected:
 
     void render();
 
+    /* Move the playback on to whichever frame the playback time is at. */
+    void updatePlayback(int delay);
+    /* Decode a frame of the recording and put it in the universe. If it fails the recording is closed and this returns false. */
+    bool decodeFrame(size_t frame);
+
     /* Mouse event functions, these pass data to the PlacingInterface. */
     void mouseMoveEvent(QMouseEvent* e);
     void mousePressEvent(QMouseEvent* e);
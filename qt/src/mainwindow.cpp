@@ -4,7 +4,11 @@
 #include <functional>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QProgressDialog>
+#include <QSlider>
 #include <QCloseEvent>
+#include <QDir>
+#include <QStandardPaths>
 #include <QMimeData>
 #include <QUrl>
 
@@ -56,19 +60,29 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), ui(new Ui::MainWi
     connect(ui->centralwidget, &PlanetsWidget::frameSwapped,                    this,               &MainWindow::frameUpdate);
     connect(ui->centralwidget, &PlanetsWidget::statusBarMessage,                ui->statusbar,      &QStatusBar::showMessage);
 
+    /* The slider can't be put in the toolbar from the .ui file. */
+    ui->playbackToolBar->addWidget(playbackSlider = new QSlider(Qt::Horizontal, ui->playbackToolBar));
+    ui->playbackToolBar->addWidget(playbackLabel = new QLabel(ui->playbackToolBar));
+    playbackLabel->setMinimumWidth(160);
+    connect(playbackSlider, &QSlider::valueChanged, this, &MainWindow::playbackSliderMoved);
+
     /* Add the actions in the tools toolbar to the menubar. */
     ui->menubar->insertMenu(ui->menuHelp->menuAction(), createPopupMenu())->setText(tr("Tools"));
 
     ui->firingSettings_DockWidget->hide();
     ui->randomSettings_DockWidget->hide();
 
-    /* Try loading file from command line arguments... */
+    /* Try loading file from command line arguments, which can also be a recording to play... */
     for (const QString& argument : QApplication::arguments()) {
         try {
-            ui->centralwidget->universe.load(argument.toStdString());
+            if (argument.endsWith(RecordingPlayer::extension))
+                ui->centralwidget->openRecording(argument.toStdString());
+            else
+                ui->centralwidget->universe.load(argument.toStdString());
             break;
         } catch (...) { /* We don't care if there are errors, just ignore them. */ }
     }
+    updatePlayback();
 
     /* Load the saved window geometry. */
     settings.beginGroup(categoryMainWindow);
@@ -97,6 +111,16 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), ui(new Ui::MainWi
     if (settings.contains(settingStepsPerFrame))
         ui->stepsPerFrameSpinBox->setValue(settings.value(settingStepsPerFrame).toInt());
 
+    /* Autosave every few minutes, going around a few files in the application's data folder. Set the interval to 0 to turn it off. */
+    settings.beginGroup(categoryAutosave);
+    saver.autosaveInterval = settings.value(settingAutosaveInterval, 5.0).toFloat() * 60.0f;
+    saver.autosaveCount = settings.value(settingAutosaveCount, 3).toInt();
+    settings.endGroup();
+
+    QString autosaveFolder = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(autosaveFolder);
+    saver.autosavePrefix = QDir(autosaveFolder).filePath("autosave").toStdString();
+
     setAcceptDrops(true);
 
     updateRecentFileActions();
@@ -127,6 +151,12 @@ void MainWindow::closeEvent(QCloseEvent* e) {
         if (result == QMessageBox::No || (result == QMessageBox::Save && !on_actionSave_Simulation_triggered()))
             return e->ignore();
     }
+
+    /* Make sure everything has been written before going. */
+    saver.wait();
+    if (!showSaveResults())
+        return e->ignore();
+
     e->accept();
 }
 
@@ -138,8 +168,10 @@ void MainWindow::on_createPlanet_PushButton_clicked() {
 }
 
 void MainWindow::on_actionClear_Velocity_triggered() {
-    if (ui->centralwidget->universe.isSelectedValid())
+    if (ui->centralwidget->universe.isSelectedValid()) {
         ui->centralwidget->universe.getSelected().velocity = glm::vec3();
+        ui->centralwidget->universe.edited();
+    }
 }
 
 void MainWindow::on_speed_Dial_valueChanged(int value) {
@@ -177,49 +209,63 @@ void MainWindow::on_actionNew_Simulation_triggered() {
 }
 
 void MainWindow::on_actionOpen_Simulation_triggered() {
-    QString filename = QFileDialog::getOpenFileName(this, tr("Open Simulation"), "", tr("Simulation files (*.xml);;All Files (*.*)"));
+    QString filename = QFileDialog::getOpenFileName(this, tr("Open Simulation"), "", tr("Simulation files (*.xml *.p3d);;All Files (*.*)"));
 
-    if (!filename.isEmpty()) {
-        /* IO functions can throw errors. */
-        try {
-            int loaded = ui->centralwidget->universe.load(filename.toStdString());
-            ui->statusbar->showMessage(("Loaded %1 planets from \"" + filename + '"').arg(loaded), 8000);
-            addRecentFile(filename);
-        } catch (const std::exception& err) {
-            QMessageBox::warning(this, tr("Error loading simulation!"), err.what());
-        }
-    }
+    if (!filename.isEmpty())
+        loadSimulation(filename, true);
 }
 
 void MainWindow::on_actionAppend_Simulation_triggered() {
-    QString filename = QFileDialog::getOpenFileName(this, tr("Append Simulation"), "", tr("Simulation files (*.xml);;All Files (*.*)"));
+    QString filename = QFileDialog::getOpenFileName(this, tr("Append Simulation"), "", tr("Simulation files (*.xml *.p3d);;All Files (*.*)"));
 
-    if (!filename.isEmpty()) {
-        /* IO functions can throw errors. */
-        try {
-            int loaded = ui->centralwidget->universe.load(filename.toStdString(), false);
-            ui->statusbar->showMessage(("Loaded %1 planets from \"" + filename + '"').arg(loaded), 8000);
-            addRecentFile(filename);
-        } catch (const std::exception& err) {
-            QMessageBox::warning(this, tr("Error loading simulation!"), err.what());
-        }
+    if (!filename.isEmpty())
+        loadSimulation(filename, false);
+}
+
+bool MainWindow::loadSimulation(const QString& filename, bool clear) {
+    if (filename.endsWith(RecordingPlayer::extension))
+        return openRecording(filename);
+
+    QProgressDialog progress(tr("Loading \"%1\"...").arg(filename), tr("Cancel"), 0, 1000, this);
+    progress.setWindowModality(Qt::WindowModal);
+    /* Most files are done before it would be worth showing. */
+    progress.setMinimumDuration(500);
+
+    bool cancelled = false;
+
+    /* IO functions can throw errors. */
+    try {
+        /* Setting the value of a modal progress dialog handles events, so the window keeps responding. */
+        int loaded = ui->centralwidget->universe.load(filename.toStdString(), clear, [&](float fraction) {
+            progress.setValue(int(fraction * 1000.0f));
+            cancelled = progress.wasCanceled();
+            return !cancelled;
+        });
+
+        if (cancelled)
+            return false;
+
+        ui->statusbar->showMessage(("Loaded %1 planets from \"" + filename + '"').arg(loaded), 8000);
+
+        /* Even if it is already in recent we add it, so it will be on top. */
+        addRecentFile(filename);
+        return true;
+    } catch (const std::exception& err) {
+        QMessageBox::warning(this, tr("Error loading simulation!"), err.what());
+        return false;
     }
 }
 
 bool MainWindow::on_actionSave_Simulation_triggered() {
     if (!ui->centralwidget->universe.isEmpty()) {
-        QString filename = QFileDialog::getSaveFileName(this, tr("Save Simulation"), "", tr("Simulation files (*.xml)"));
+        QString filename = QFileDialog::getSaveFileName(this, tr("Save Simulation"), "", tr("Simulation files (*.xml);;Binary simulation files (*.p3d)"));
 
         if (!filename.isEmpty()) {
-            /* IO functions can throw errors. */
-            try {
-                ui->centralwidget->universe.save(filename.toStdString());
-                ui->statusbar->showMessage("Simulation saved to \"" + filename + '"', 8000);
-                addRecentFile(filename);
-                return true;
-            } catch (const std::exception& err) {
-                QMessageBox::warning(this, tr("Error Saving Simulation."), err.what());
-            }
+            /* It's written in the background, frameUpdate() shows how it went. */
+            saver.save(ui->centralwidget->universe, filename.toStdString());
+            ui->statusbar->showMessage("Saving simulation to \"" + filename + "\"...");
+            addRecentFile(filename);
+            return true;
         }
     } else {
         QMessageBox::warning(this, tr("Error Saving Simulation."), tr("No planets to save!"));
@@ -244,6 +290,104 @@ void MainWindow::on_actionAbout_triggered() {
                        .arg(version::cmake_version));
 }
 
+void MainWindow::on_actionRecord_Simulation_toggled(bool value) {
+    if (!value) {
+        if (ui->centralwidget->recorder)
+            ui->statusbar->showMessage(tr("Recorded %1 frames").arg(ui->centralwidget->recorder->frames()), 8000);
+        ui->centralwidget->recorder.reset();
+        return;
+    }
+
+    QString filename = QFileDialog::getSaveFileName(this, tr("Record Simulation"), "", tr("Recordings (*%1)").arg(RecordingPlayer::extension));
+
+    try {
+        if (!filename.isEmpty()) {
+            ui->centralwidget->recorder.reset(new Recorder(filename.toStdString()));
+            ui->statusbar->showMessage("Recording simulation to \"" + filename + "\"...");
+            return;
+        }
+    } catch (const std::exception& err) {
+        QMessageBox::warning(this, tr("Error recording simulation!"), err.what());
+    }
+
+    ui->actionRecord_Simulation->setChecked(false);
+}
+
+void MainWindow::on_actionOpen_Recording_triggered() {
+    QString filename = QFileDialog::getOpenFileName(this, tr("Open Recording"), "", tr("Recordings (*%1);;All Files (*.*)").arg(RecordingPlayer::extension));
+
+    if (!filename.isEmpty())
+        openRecording(filename);
+}
+
+bool MainWindow::openRecording(const QString& filename) {
+    try {
+        ui->centralwidget->openRecording(filename.toStdString());
+    } catch (const std::exception& err) {
+        QMessageBox::warning(this, tr("Error opening recording!"), err.what());
+        return false;
+    }
+
+    ui->statusbar->showMessage(tr("Playing %1 frames from \"%2\"").arg(ui->centralwidget->player->frames()).arg(filename), 8000);
+    addRecentFile(filename);
+    updatePlayback();
+    return true;
+}
+
+void MainWindow::on_actionPlay_Recording_toggled(bool value) {
+    PlanetsWidget* widget = ui->centralwidget;
+
+    if (!widget->player || widget->playing == value)
+        return;
+
+    /* Playing from the end starts again. */
+    if (value && widget->player->currentFrame() + 1 == widget->player->frames())
+        widget->showFrame(0);
+
+    /* Showing a frame closes the recording if it can't be read. */
+    if (widget->player)
+        widget->playing = value;
+}
+
+void MainWindow::on_actionClose_Recording_triggered() {
+    if (ui->centralwidget->player)
+        ui->centralwidget->closeRecording();
+    updatePlayback();
+}
+
+void MainWindow::playbackSliderMoved(int value) {
+    if (ui->centralwidget->player && size_t(value) != ui->centralwidget->player->currentFrame())
+        ui->centralwidget->showFrame(size_t(value));
+}
+
+void MainWindow::updatePlayback() {
+    const PlanetsWidget* widget = ui->centralwidget;
+
+    ui->playbackToolBar->setVisible(widget->player != nullptr);
+    ui->actionRecord_Simulation->setEnabled(widget->player == nullptr);
+
+    /* Recording stops by itself if writing fails. */
+    if (ui->actionRecord_Simulation->isChecked() && !widget->recorder)
+        ui->actionRecord_Simulation->setChecked(false);
+
+    if (!widget->player)
+        return;
+
+    const RecordingPlayer& player = *widget->player;
+
+    /* Only the user moving them should change the frame. */
+    playbackSlider->blockSignals(true);
+    playbackSlider->setMaximum(int(player.frames()) - 1);
+    playbackSlider->setValue(int(player.currentFrame()));
+    playbackSlider->blockSignals(false);
+
+    ui->actionPlay_Recording->blockSignals(true);
+    ui->actionPlay_Recording->setChecked(widget->playing);
+    ui->actionPlay_Recording->blockSignals(false);
+
+    playbackLabel->setText(tr("%1s of %2s").arg(player.frameTime(player.currentFrame()), 0, 'f', 2).arg(player.frameTime(player.frames() - 1), 0, 'f', 2));
+}
+
 void MainWindow::on_stepsPerFrameSpinBox_valueChanged(int value) {
     ui->centralwidget->universe.stepsPerFrame = value;
 }
@@ -280,6 +424,10 @@ void MainWindow::on_actionDraw_Planar_Circles_toggled(bool value) {
     ui->centralwidget->drawPlanarCircles = value;
 }
 
+void MainWindow::on_actionSphere_Impostors_toggled(bool value) {
+    ui->centralwidget->drawImpostors = value;
+}
+
 void MainWindow::on_actionHide_Planets_toggled(bool value) {
     ui->centralwidget->hidePlanets = value;
 
@@ -359,18 +507,7 @@ void MainWindow::openRecentFile() {
     /* Get the QAction that sent the signal. If it wasn't a QAction, just ignore it. */
     if (QAction* action = qobject_cast<QAction*>(sender())) {
         /* The tooltip is full path to the file. */
-        QString path = action->toolTip();
-
-        try {
-            int loaded = ui->centralwidget->universe.load(path.toStdString());
-
-            ui->statusbar->showMessage(("Loaded %1 planets from \"" + path + '"').arg(loaded), 8000);
-
-            /* Even though it is already in recent we add it, so it will be on top. */
-            addRecentFile(path);
-        } catch (const std::exception& err) {
-            QMessageBox::warning(this, tr("Error loading simulation!"), err.what());
-        }
+        loadSimulation(action->toolTip(), true);
     }
 }
 
@@ -384,19 +521,9 @@ void MainWindow::dragEnterEvent(QDragEnterEvent* event) {
 }
 
 void MainWindow::dropEvent(QDropEvent* event) {
-    for (const QUrl& url : event->mimeData()->urls()) {
-        /* IO functions can throw errors. */
-        try {
-            int loaded = ui->centralwidget->universe.load(url.toLocalFile().toStdString());
-
-            ui->statusbar->showMessage(("Loaded %1 planets from \"" + url.toLocalFile() + '"').arg(loaded), 8000);
-
-            addRecentFile(url.toLocalFile());
+    for (const QUrl& url : event->mimeData()->urls())
+        if (loadSimulation(url.toLocalFile(), true))
             return event->acceptProposedAction();
-        } catch (const std::exception& err) {
-            QMessageBox::warning(this, tr("Error loading simulation!"), err.what());
-        }
-    }
 }
 
 bool MainWindow::event(QEvent* event) {
@@ -417,7 +544,26 @@ bool MainWindow::event(QEvent* event) {
     return QMainWindow::event(event);
 }
 
+bool MainWindow::showSaveResults() {
+    bool succeeded = true;
+
+    for (const BackgroundSaver::Result& result : saver.results()) {
+        if (result.error.empty()) {
+            ui->statusbar->showMessage("Simulation saved to \"" + QString::fromStdString(result.filename) + '"', 8000);
+        } else {
+            QMessageBox::warning(this, tr("Error Saving Simulation."), QString::fromStdString(result.error));
+            succeeded = false;
+        }
+    }
+
+    return succeeded;
+}
+
 void MainWindow::frameUpdate() {
+    saver.autosave(ui->centralwidget->universe);
+    showSaveResults();
+    updatePlayback();
+
     if (ui->centralwidget->universe.size() == 1)
         planetCountLabel->setText(tr("1 planet"));
     else
@@ -428,7 +574,7 @@ void MainWindow::frameUpdate() {
         ui->speed_Dial->setValue(int(ui->centralwidget->universe.simspeed * ui->speed_Dial->maximum() / speeddialmax));
 
     if (ui->centralwidget->universe.isSelectedValid()) {
-        const Planet& selected = ui->centralwidget->universe.getSelected();
+        ConstPlanetRef selected = ui->centralwidget->universe.getSelected();
 
         glm::vec3 velocity = selected.velocity / ui->centralwidget->universe.velocityfac;
 
@@ -455,3 +601,6 @@ const QString MainWindow::settingGridDimensions =   "GridDimensions";
 const QString MainWindow::settingTrailLength =      "TrailLength";
 const QString MainWindow::settingTrailDelta =       "TrailDelta";
 const QString MainWindow::settingStepsPerFrame =    "StepsPerFrame";
+const QString MainWindow::categoryAutosave =        "Autosave";
+const QString MainWindow::settingAutosaveInterval = "IntervalMinutes";
+const QString MainWindow::settingAutosaveCount =    "Count";
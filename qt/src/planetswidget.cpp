@@ -3,6 +3,10 @@
 #include <QMouseEvent>
 #include <QOpenGLFramebufferObject>
 #include <QApplication>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+#include <QOpenGLExtraFunctions>
+#endif
+#include <algorithm>
 #include <limits>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
@@ -10,7 +14,7 @@
 #include <glm/gtx/norm.hpp>
 
 PlanetsWidget::PlanetsWidget(QWidget* parent) : QOpenGLWidget(parent), placing(universe), camera(universe),
-    screenshotDir(QDir::homePath() + "/Pictures/Planets3D-Screenshots/"), highResSphereTris(QOpenGLBuffer::IndexBuffer),
+    screenshotDir(QDir::homePath() + "/Pictures/Planets3D-Screenshots/"), planetSphereIndices(QOpenGLBuffer::IndexBuffer),
 #ifdef PLANETS3D_QT_USE_SDL_GAMEPAD
     gamepad(universe, camera, placing),
 #endif
@@ -40,6 +44,7 @@ void PlanetsWidget::initializeGL() {
     shaderTexture.bindAttributeLocation("normal",   normal);
     shaderTexture.bindAttributeLocation("tangent",  tangent);
     shaderTexture.bindAttributeLocation("uv",       uv);
+    shaderTexture.bindAttributeLocation("instance", instance);
 
     shaderTexture.link();
 
@@ -87,6 +92,35 @@ void PlanetsWidget::initializeGL() {
     /* This vertex attribute should always be enabled. */
     shaderColor.enableAttributeArray(vertex);
 
+    /* When the instance attribute isn't an array, the model matrix places the sphere instead. */
+    shaderTexture.setAttributeValue(instance, 0.0f, 0.0f, 0.0f, 1.0f);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+    /* Instanced attributes are core in OpenGL 3.3 and OpenGL ES 3, older contexts draw each planet on its own. */
+    const QSurfaceFormat format = context()->format();
+    instancing = format.version() >= (context()->isOpenGLES() ? qMakePair(3, 0) : qMakePair(3, 3));
+#endif
+
+    impostors = instancing && (!context()->isOpenGLES() || context()->hasExtension("GL_EXT_frag_depth"));
+
+    if (impostors) {
+        /* Load the shaders from the qrc. */
+        shaderImpostor.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/impostor.vsh");
+        shaderImpostor.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/impostor.fsh");
+
+        shaderImpostor.bindAttributeLocation("vertex",   vertex);
+        shaderImpostor.bindAttributeLocation("instance", instance);
+
+        impostors = shaderImpostor.link();
+
+        /* Get the uniform values */
+        shaderImpostor_cameraMatrix = shaderImpostor.uniformLocation("cameraMatrix");
+        shaderImpostor_viewMatrix = shaderImpostor.uniformLocation("viewMatrix");
+        shaderImpostor_eye = shaderImpostor.uniformLocation("eye");
+        shaderImpostor_up = shaderImpostor.uniformLocation("up");
+        shaderImpostor_lightDir = shaderImpostor.uniformLocation("lightDir");
+    }
+
     /* The one and only texture. */
     QImage diff(":/textures/planet_diffuse.png");
     QImage nrm(":/textures/planet_nrm.png");
@@ -96,18 +130,19 @@ void PlanetsWidget::initializeGL() {
 
     /* Begin vertex/index buffer allocation. */
 
-    const static Sphere<64, 32> highResSphere;
+    const static SphereLevels planetSpheres;
     const static Sphere<32, 16> lowResSphere;
     const static Circle<64> circle;
+    const static ImpostorQuad impostor;
 
-    highResSphereVerts.create();
-    highResSphereVerts.bind();
-    highResSphereVerts.allocate(highResSphere.verts, highResSphere.vertexCount * sizeof(Vertex));
+    planetSphereVerts.create();
+    planetSphereVerts.bind();
+    planetSphereVerts.allocate(planetSpheres.verts.data(), int(planetSpheres.verts.size() * sizeof(Vertex)));
 
-    highResSphereTris.create();
-    highResSphereTris.bind();
-    highResSphereTris.allocate(highResSphere.triangles, highResSphere.triangleCount * sizeof(unsigned int));
-    highResSphereTriCount = highResSphere.triangleCount;
+    planetSphereIndices.create();
+    planetSphereIndices.bind();
+    planetSphereIndices.allocate(planetSpheres.indices.data(), int(planetSpheres.indices.size() * sizeof(uint32_t)));
+    std::copy(planetSpheres.indexStart, planetSpheres.indexStart + SphereLevels::levels + 1, planetIndexStart);
 
     lowResSphereVerts.create();
     lowResSphereVerts.bind();
@@ -127,11 +162,26 @@ void PlanetsWidget::initializeGL() {
     circleLines.allocate(circle.lines, circle.lineCount * sizeof(unsigned int));
     circleLineCount = circle.lineCount;
 
+    impostorVerts.create();
+    impostorVerts.bind();
+    impostorVerts.allocate(impostor.verts, impostor.vertexCount * sizeof(glm::vec2));
+
+    instanceVerts.create();
+    instanceVerts.setUsagePattern(QOpenGLBuffer::StreamDraw);
+
+    /* Allocated once the trails are known. */
+    trailVerts.create();
+    trailVerts.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    trailBuffer.reset();
+
     QOpenGLBuffer::release(QOpenGLBuffer::VertexBuffer);
     QOpenGLBuffer::release(QOpenGLBuffer::IndexBuffer);
 
     /* End vertex/index buffer allocation. */
 
+    if (!simulation.isRunning() && !player)
+        simulation.start(universe);
+
     /* If we haven't rendered any frames yet, start the timer. */
     if (frameCount == 0) {
         totalTime.start();
@@ -154,9 +204,17 @@ void PlanetsWidget::paintGL() {
     gamepad.doControllerAxisInput(delay);
 #endif
 
-    /* Don't advance if placing. */
-    if (placing.step == PlacingInterface::NotPlacing || placing.step == PlacingInterface::Firing)
-        universe.advance(delay);
+    if (player) {
+        updatePlayback(delay);
+    } else if (simulation.sync(universe, placing.step == PlacingInterface::NotPlacing || placing.step == PlacingInterface::Firing) && recorder) {
+        /* Pick up the newest state from the simulation thread, and hold it still while placing. Each new one is recorded. */
+        try {
+            recorder->record(universe, simulation.time() * 1.0e-6);
+        } catch (const std::exception& error) {
+            recorder.reset();
+            emit statusBarMessage(error.what(), 8000);
+        }
+    }
 
     render();
 
@@ -166,6 +224,65 @@ void PlanetsWidget::paintGL() {
     emit updateFPSStatusMessage(tr("fps: %1").arg(1.0e6f / delay));
 }
 
+void PlanetsWidget::openRecording(const std::string& filename) {
+    std::unique_ptr<RecordingPlayer> opened(new RecordingPlayer(filename));
+    if (opened->frames() == 0)
+        throw std::runtime_error("There's nothing in the recording!");
+
+    /* Make sure it can be read before stopping anything. */
+    opened->seek(0);
+
+    player.swap(opened);
+    recorder.reset();
+    simulation.stop();
+    universe.deleteAll();
+
+    player->show(universe);
+    playing = true;
+    playbackTime = player->frameTime(0);
+}
+
+void PlanetsWidget::closeRecording() {
+    player.reset();
+    universe.deleteAll();
+    simulation.start(universe);
+}
+
+void PlanetsWidget::showFrame(size_t frame) {
+    if (decodeFrame(frame))
+        playbackTime = player->frameTime(frame);
+}
+
+bool PlanetsWidget::decodeFrame(size_t frame) {
+    if (frame == player->currentFrame())
+        return true;
+
+    try {
+        player->seek(frame);
+        player->show(universe);
+        return true;
+    } catch (const std::exception& error) {
+        emit statusBarMessage(error.what(), 8000);
+        closeRecording();
+        return false;
+    }
+}
+
+void PlanetsWidget::updatePlayback(int delay) {
+    if (!playing)
+        return;
+
+    /* The delay is in microseconds. */
+    playbackTime += delay * 1.0e-6 * universe.simspeed;
+
+    size_t frame = player->currentFrame();
+    while (frame + 1 < player->frames() && player->frameTime(frame + 1) <= playbackTime)
+        ++frame;
+
+    if (decodeFrame(frame) && frame + 1 == player->frames())
+        playing = false;
+}
+
 void PlanetsWidget::render() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -195,8 +312,8 @@ void PlanetsWidget::render() {
         glActiveTexture(GL_TEXTURE1);
         texture_nrm->bind();
 
-        highResSphereVerts.bind();
-        highResSphereTris.bind();
+        planetSphereVerts.bind();
+        planetSphereIndices.bind();
 
         /* Set up the attribute buffers once for all planets. */
         shaderTexture.setAttributeBuffer(vertex,    GL_FLOAT, 0,                            3, sizeof(Vertex));
@@ -204,18 +321,85 @@ void PlanetsWidget::render() {
         shaderTexture.setAttributeBuffer(tangent,   GL_FLOAT, offsetof(Vertex, tangent),    3, sizeof(Vertex));
         shaderTexture.setAttributeBuffer(uv,        GL_FLOAT, offsetof(Vertex, uv),         2, sizeof(Vertex));
 
-        for (const auto& i : universe) {
-            /* Set up a matrix for the planet's position and size. */
-            glm::mat4 matrix = glm::translate(i.position);
-            matrix = glm::scale(matrix, glm::vec3(i.radius() * drawScale));
-            glUniformMatrix4fv(shaderTexture_modelMatrix, 1, GL_FALSE, glm::value_ptr(matrix));
+        /* Pick how detailed each planet needs to be, and group them by it. */
+        planetInstances.update(universe, camera, drawScale);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+        if (instancing) {
+            QOpenGLExtraFunctions* extra = context()->extraFunctions();
+
+            /* Upload every planet's position and radius, and draw each level all at once. */
+            instanceVerts.bind();
+            instanceVerts.allocate(planetInstances.instances.data(), int(planetInstances.size() * sizeof(glm::vec4)));
+
+            shaderTexture.enableAttributeArray(instance);
+            extra->glVertexAttribDivisor(instance, 1);
+
+            glUniformMatrix4fv(shaderTexture_modelMatrix, 1, GL_FALSE, glm::value_ptr(glm::mat4()));
+
+            /* Impostors take care of everything but the points. */
+            const bool useImpostors = drawImpostors && impostors;
+
+            for (int level = useImpostors ? SphereLevels::pointLevel : 0; level < PlanetInstances::levels; ++level) {
+                if (planetInstances.levelSize(level) == 0)
+                    continue;
+
+                /* Start the instances at the level's first planet. */
+                shaderTexture.setAttributeBuffer(instance, GL_FLOAT, int(planetInstances.levelStart[level] * sizeof(glm::vec4)), 4, sizeof(glm::vec4));
+
+                extra->glDrawElementsInstanced(level == SphereLevels::pointLevel ? GL_POINTS : GL_TRIANGLES,
+                                               planetIndexStart[level + 1] - planetIndexStart[level], GL_UNSIGNED_INT,
+                                               (void*)(planetIndexStart[level] * sizeof(uint32_t)), GLsizei(planetInstances.levelSize(level)));
+            }
+
+            if (useImpostors && planetInstances.levelStart[SphereLevels::pointLevel] > 0) {
+                shaderTexture.disableAttributeArray(normal);
+                shaderTexture.disableAttributeArray(tangent);
+                shaderTexture.disableAttributeArray(uv);
+
+                shaderImpostor.bind();
+
+                shaderImpostor.setUniformValue("texture_diff", 0);
+                shaderImpostor.setUniformValue("texture_nrm", 1);
+
+                glUniformMatrix4fv(shaderImpostor_cameraMatrix, 1, GL_FALSE, glm::value_ptr(camera.camera));
+                glUniformMatrix4fv(shaderImpostor_viewMatrix, 1, GL_FALSE, glm::value_ptr(camera.view));
+                glUniform3fv(shaderImpostor_lightDir, 1, glm::value_ptr(light));
+                glUniform3fv(shaderImpostor_eye, 1, glm::value_ptr(camera.getEye()));
+                glUniform3fv(shaderImpostor_up, 1, glm::value_ptr(camera.getUp()));
 
-            /* Draw the high resolution sphere. */
-            glDrawElements(GL_TRIANGLES, highResSphereTriCount, GL_UNSIGNED_INT, nullptr);
+                shaderImpostor.setAttributeBuffer(instance, GL_FLOAT, 0, 4, sizeof(glm::vec4));
+
+                impostorVerts.bind();
+                shaderImpostor.setAttributeBuffer(vertex, GL_FLOAT, 0, 2, sizeof(glm::vec2));
+
+                extra->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, ImpostorQuad::vertexCount, GLsizei(planetInstances.levelStart[SphereLevels::pointLevel]));
+
+                impostorVerts.release();
+            }
+
+            extra->glVertexAttribDivisor(instance, 0);
+            shaderTexture.disableAttributeArray(instance);
+            instanceVerts.release();
+        } else
+#endif
+        for (int level = 0; level < PlanetInstances::levels; ++level) {
+            for (size_t i = planetInstances.levelStart[level]; i < planetInstances.levelStart[level + 1]; ++i) {
+                const glm::vec4& planet = planetInstances.instances[i];
+
+                /* Set up a matrix for the planet's position and size. */
+                glm::mat4 matrix = glm::translate(glm::vec3(planet));
+                matrix = glm::scale(matrix, glm::vec3(planet.w));
+                glUniformMatrix4fv(shaderTexture_modelMatrix, 1, GL_FALSE, glm::value_ptr(matrix));
+
+                glDrawElements(level == SphereLevels::pointLevel ? GL_POINTS : GL_TRIANGLES,
+                               planetIndexStart[level + 1] - planetIndexStart[level], GL_UNSIGNED_INT,
+                               (void*)(planetIndexStart[level] * sizeof(uint32_t)));
+            }
         }
 
-        highResSphereVerts.release();
-        highResSphereTris.release();
+        planetSphereVerts.release();
+        planetSphereIndices.release();
 
         /* That's the only thing that uses then normals, tangents, and uv coords. */
         shaderTexture.disableAttributeArray(normal);
@@ -243,10 +427,21 @@ void PlanetsWidget::render() {
         shaderColor.setUniformValue(shaderColor_modelMatrix, QMatrix4x4());
         shaderColor.setUniformValue(shaderColor_color, trailColor);
 
-        for (const auto& i : universe) {
-            shaderColor.setAttributeArray(vertex, GL_FLOAT, i.path.data(), 3);
-            glDrawArrays(GL_LINE_STRIP, 0, GLsizei(i.path.size()));
-        }
+        trailVerts.bind();
+
+        if (trailBuffer.update(universe))
+            trailVerts.allocate(int(trailBuffer.size() * sizeof(glm::vec3)));
+
+        for (const TrailBuffer::Upload& upload : trailBuffer.uploads)
+            trailVerts.write(int(upload.offset * sizeof(glm::vec3)), upload.data, int(upload.count * sizeof(glm::vec3)));
+
+        shaderColor.setAttributeBuffer(vertex, GL_FLOAT, 0, 3, sizeof(glm::vec3));
+
+        /* OpenGL ES 2 doesn't have glMultiDrawArrays, but at least nothing comes from client memory any more. */
+        for (size_t i = 0; i < trailBuffer.firsts.size(); ++i)
+            glDrawArrays(GL_LINE_STRIP, trailBuffer.firsts[i], trailBuffer.counts[i]);
+
+        trailVerts.release();
     }
 
     switch (placing.step) {
@@ -569,3 +764,4 @@ const int PlanetsWidget::vertex     = 0;
 const int PlanetsWidget::normal     = 1;
 const int PlanetsWidget::tangent    = 2;
 const int PlanetsWidget::uv         = 3;
+const int PlanetsWidget::instance   = 4;
@@ -7,10 +7,16 @@
 #include "planetsuniverse.h"
 #include "placinginterface.h"
 #include "grid.h"
+#include "trailbuffer.h"
+#include "planetinstances.h"
+#include "simulationthread.h"
+#include "backgroundsaver.h"
+#include "recording.h"
 #include "camera.h"
 #include "sdlgamepad.h"
 #include <SDL.h>
 #include <array>
+#include <memory>
 
 class PlanetsWindow{
     /* Universe and basic interface classes. */
@@ -18,6 +24,25 @@ class PlanetsWindow{
     PlacingInterface placing;
     Camera camera;
 
+    /* Advances the universe on its own thread, the universe above is the latest snapshot of it. */
+    SimulationThread simulation;
+
+    /* Writes saves in the background. Everything goes in the user's data folder, which saveFolder holds. */
+    BackgroundSaver saver;
+    std::string saveFolder;
+    bool autosave = true;
+    /* The last file saved, or the error if it failed. */
+    std::string lastSave;
+
+    /* Records every snapshot from the simulation while set, to recordingName in the save folder. */
+    std::unique_ptr<Recorder> recorder;
+    std::string recordingName;
+
+    /* Plays a recording back instead of simulating while set. The time is in simulated seconds, and goes at the sim speed. */
+    std::unique_ptr<RecordingPlayer> player;
+    bool playing = true;
+    double playbackTime = 0.0;
+
     /* Store the current speed in here when pausing. */
     float pauseSpeed = 1.0f;
 
@@ -48,16 +73,35 @@ class PlanetsWindow{
     /* GL shader and uniform handles for flat color shader. */
     unsigned int shaderColor, shaderColor_cameraMatrix, shaderColor_modelMatrix, shaderColor_color;
 
+    /* GL shader and uniform handles for the sphere impostor shader. */
+    unsigned int shaderImpostor, shaderImpostor_cameraMatrix, shaderImpostor_viewMatrix, shaderImpostor_eye, shaderImpostor_up, shaderImpostor_lightDir;
+
     /* GL shader and uniform handles for dear imgui. */
     unsigned int shaderUI, shaderUI_matrix;
 
     /* The diffuse and normalmap textures for planets. */
     unsigned int planetTexture_diff, planetTexture_nrm;
 
-    unsigned int highResVBO, highResTriIBO, highResTriCount;
+    /* Every level of detail for planets, see SphereLevels. */
+    unsigned int planetVBO, planetIBO;
+    uint32_t planetIndexStart[SphereLevels::levels + 1];
     unsigned int lowResVBO, lowResLineIBO, lowResLineCount;
     unsigned int circleVBO, circleLineIBO, circleLineCount;
 
+    /* The position, radius, and level of detail of every planet, so they can be drawn with one call per level. Needs OpenGL 3.3. */
+    bool instancing = false;
+    unsigned int instanceVBO;
+    PlanetInstances planetInstances;
+
+    /* Draw planets as one quad each with the sphere traced in the fragment shader, instead of with the sphere meshes.
+     * Only planets too small for anything but a point still use them. Needs instancing. */
+    bool drawImpostors = false;
+    unsigned int impostorVBO;
+
+    /* Every trail lives in this one buffer, only the points that changed get uploaded each frame. */
+    unsigned int trailVBO;
+    TrailBuffer trailBuffer;
+
     void updateGrid();
 
     /* Called to update universe based on SDL events. */
@@ -84,6 +128,22 @@ class PlanetsWindow{
     /* Call to show a confirmation message to delete planets. */
     void newUniverse();
 
+    /* Save the universe to a new file named after the time. */
+    void saveUniverse();
+    /* Autosave if it's time to, and check on how the saves went. Called once a frame. */
+    void updateSaves();
+
+    /* Start recording to a new file named after the time, or stop if already recording. */
+    void toggleRecording();
+    /* Stop simulating and play the recording instead, returns false if it isn't one. */
+    bool openRecording(const char* filename);
+    /* Go back to simulating, starting with an empty universe. */
+    void closeRecording();
+    /* Move on to whichever frame the playback time is at. */
+    void updatePlayback(const float delay);
+    /* Decode a frame and put it in the universe. If it can't be read the recording is closed and this returns false. */
+    bool showFrame(size_t frame);
+
     /* Called whenever window gets resized. */
     void onResized(uint32_t width, uint32_t height);
 
@@ -119,6 +179,9 @@ class PlanetsWindow{
     float planetGenMaxSpeed = 1.0f;
     float planetGenMaxMass = 200.0f;
 
+    /* What the random generator is reseeded with when deterministic mode is turned on. */
+    int deterministicSeed = 0;
+
 public:
     /* Create the window, expects command line arguments as passed to a standard main(int argc, char* argv[]) function. */
     PlanetsWindow(int argc, char* argv[]);
@@ -11,7 +11,9 @@ enum VertexAttrib {
     vertex,
     normal,
     tangent,
-    uv
+    uv,
+    /* Position and radius of each planet when drawing them instanced, see PlanetInstances. */
+    instance
 };
 
 /* Functions for compiling and linking shaders. */
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <chrono>
+#include <ctime>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -20,28 +21,54 @@ PlanetsWindow::PlanetsWindow(int argc, char* argv[]) : placing(universe), camera
 
     gamepad.closeFunction = std::bind(&PlanetsWindow::onClose, this);
 
-    /* Try loading from the command line. Ignore invalid files and break on the first successful file. */
+    if (char* path = SDL_GetPrefPath("Planets3D", "Planets3D")) {
+        saveFolder = path;
+        SDL_free(path);
+    }
+
+    /* Autosave every 5 minutes, going around 3 files. */
+    saver.autosaveInterval = 300.0f;
+    saver.autosaveCount = 3;
+    saver.autosavePrefix = saveFolder + "autosave";
+
+    /* Try loading from the command line. Ignore invalid files and break on the first successful file, which can also be a recording. */
     for (int i = 0; i < argc; ++i) {
+        if (openRecording(argv[i]))
+            break;
+
         try {
             universe.load(argv[i]); break;
         } catch (...) {}
     }
 }
 
+/* A file in the folder named after the current time. */
+static std::string timestampedName(const std::string& folder, const char* extension) {
+    char name[64];
+    const std::time_t now = std::time(nullptr);
+    std::strftime(name, sizeof(name), "planets3d-%Y%m%d-%H%M%S", std::localtime(&now));
+
+    return folder + name + extension;
+}
+
 PlanetsWindow::~PlanetsWindow() {
     ImGui::Shutdown();
 
     /* Delete vertex & index buffers. */
-    glDeleteBuffers(1, &highResVBO);
-    glDeleteBuffers(1, &highResTriIBO);
+    glDeleteBuffers(1, &planetVBO);
+    glDeleteBuffers(1, &planetIBO);
     glDeleteBuffers(1, &lowResVBO);
     glDeleteBuffers(1, &lowResLineIBO);
     glDeleteBuffers(1, &circleVBO);
     glDeleteBuffers(1, &circleLineIBO);
+    glDeleteBuffers(1, &trailVBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteBuffers(1, &impostorVBO);
 
     /* No more shaders. */
     glDeleteProgram(shaderTexture);
     glDeleteProgram(shaderColor);
+    glDeleteProgram(shaderImpostor);
 
     /* Die textures. */
     glDeleteTextures(1, &planetTexture_diff);
@@ -109,6 +136,15 @@ void PlanetsWindow::initGL() {
 
     printf("GL Vendor: \"%s\", Renderer: \"%s\".\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
 
+    /* Instanced attributes only became core in 3.3, older contexts draw each planet on its own. */
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    instancing = major > 3 || (major == 3 && minor >= 3);
+
+    /* When the instance attribute isn't an array, the model matrix places the sphere instead. */
+    glVertexAttrib4f(instance, 0.0f, 0.0f, 0.0f, 1.0f);
+
     initShaders();
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -198,6 +234,22 @@ void PlanetsWindow::initShaders() {
     glUniform1i(glGetUniformLocation(shaderTexture, "texture_diff"), 0);
     glUniform1i(glGetUniformLocation(shaderTexture, "texture_nrm"), 1);
 
+    /* Compile the sphere impostor shader included in res.h as const char*. */
+    GLuint shaderImpostor_vsh = compileShader(impostor_vsh, GL_VERTEX_SHADER);
+    GLuint shaderImpostor_fsh = compileShader(impostor_fsh, GL_FRAGMENT_SHADER);
+    shaderImpostor = linkShaderProgram(shaderImpostor_vsh, shaderImpostor_fsh);
+
+    /* Get the uniform locations from the impostor shader. */
+    glUseProgram(shaderImpostor);
+    shaderImpostor_cameraMatrix = glGetUniformLocation(shaderImpostor, "cameraMatrix");
+    shaderImpostor_viewMatrix   = glGetUniformLocation(shaderImpostor, "viewMatrix");
+    shaderImpostor_eye          = glGetUniformLocation(shaderImpostor, "eye");
+    shaderImpostor_up           = glGetUniformLocation(shaderImpostor, "up");
+    shaderImpostor_lightDir     = glGetUniformLocation(shaderImpostor, "lightDir");
+
+    glUniform1i(glGetUniformLocation(shaderImpostor, "texture_diff"), 0);
+    glUniform1i(glGetUniformLocation(shaderImpostor, "texture_nrm"), 1);
+
     /* Compile the UI shader included in res.h as const char*. */
     GLuint shaderUI_vsh = compileShader(ui_vsh, GL_VERTEX_SHADER);
     GLuint shaderUI_fsh = compileShader(ui_fsh, GL_FRAGMENT_SHADER);
@@ -210,17 +262,18 @@ void PlanetsWindow::initShaders() {
 }
 
 void PlanetsWindow::initBuffers() {
-    Sphere<64, 32> highResSphere;
+    SphereLevels planetSpheres;
     Sphere<32, 16> lowResSphere;
     Circle<64> circle;
+    ImpostorQuad impostor;
 
-    glGenBuffers(1, &highResVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, highResVBO);
-    glBufferData(GL_ARRAY_BUFFER, highResSphere.vertexCount * sizeof(Vertex), highResSphere.verts, GL_STATIC_DRAW);
+    glGenBuffers(1, &planetVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, planetVBO);
+    glBufferData(GL_ARRAY_BUFFER, planetSpheres.verts.size() * sizeof(Vertex), planetSpheres.verts.data(), GL_STATIC_DRAW);
 
-    glGenBuffers(1, &highResTriIBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, highResTriIBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, highResSphere.triangleCount * sizeof(uint32_t), highResSphere.triangles, GL_STATIC_DRAW);
+    glGenBuffers(1, &planetIBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, planetIBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, planetSpheres.indices.size() * sizeof(uint32_t), planetSpheres.indices.data(), GL_STATIC_DRAW);
 
     glGenBuffers(1, &lowResVBO);
     glBindBuffer(GL_ARRAY_BUFFER, lowResVBO);
@@ -238,7 +291,15 @@ void PlanetsWindow::initBuffers() {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, circleLineIBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, circle.lineCount * sizeof(uint32_t), circle.lines, GL_STATIC_DRAW);
 
-    highResTriCount = highResSphere.triangleCount;
+    glGenBuffers(1, &impostorVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, impostorVBO);
+    glBufferData(GL_ARRAY_BUFFER, impostor.vertexCount * sizeof(glm::vec2), impostor.verts, GL_STATIC_DRAW);
+
+    /* Allocated once the trails are known. */
+    glGenBuffers(1, &trailVBO);
+    glGenBuffers(1, &instanceVBO);
+
+    std::copy(planetSpheres.indexStart, planetSpheres.indexStart + SphereLevels::levels + 1, planetIndexStart);
     lowResLineCount = lowResSphere.lineCount;
     circleLineCount = circle.lineCount;
 }
@@ -343,6 +404,10 @@ void PlanetsWindow::run() {
     /* Remains true from here until application closes. */
     running = true;
 
+    /* A recording from the command line plays instead. */
+    if (!player)
+        simulation.start(universe);
+
     typedef std::chrono::high_resolution_clock clock;
     using std::chrono::duration_cast;
     using std::chrono::microseconds;
@@ -376,9 +441,19 @@ void PlanetsWindow::run() {
         gamepad.doControllerAxisInput(delay);
         doEvents();
 
-        /* Don't advance if we're placing. */
-        if (placing.step == PlacingInterface::NotPlacing || placing.step == PlacingInterface::Firing)
-            universe.advance(float(delay));
+        if (player) {
+            updatePlayback(delay * 1.0e-6f);
+        } else if (simulation.sync(universe, placing.step == PlacingInterface::NotPlacing || placing.step == PlacingInterface::Firing) && recorder) {
+            /* Pick up the newest state from the simulation thread, and hold it still if we're placing. Each new one is recorded. */
+            try {
+                recorder->record(universe, simulation.time() * 1.0e-6);
+            } catch (const std::exception& error) {
+                recorder.reset();
+                SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_WARNING, "Error Recording Simulation", error.what(), windowSDL);
+            }
+        }
+
+        updateSaves();
 
         paint();
         /* UI time is measured in seconds. */
@@ -426,8 +501,8 @@ void PlanetsWindow::paint() {
     glUniformMatrix4fv(shaderTexture_cameraMatrix, 1, GL_FALSE, glm::value_ptr(camera.camera));
     glUniformMatrix4fv(shaderTexture_viewMatrix, 1, GL_FALSE, glm::value_ptr(camera.view));
 
-    glBindBuffer(GL_ARRAY_BUFFER, highResVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, highResTriIBO);
+    glBindBuffer(GL_ARRAY_BUFFER, planetVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, planetIBO);
 
     /* Bind all the vertex attributes for the fully lit sphere. */
     glVertexAttribPointer(vertex,   3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
@@ -440,14 +515,70 @@ void PlanetsWindow::paint() {
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, planetTexture_nrm);
 
-    for (const auto& i : universe) {
-        /* Create a matrix translated by the position and scaled by the radius. */
-        glm::mat4 matrix = glm::translate(i.position);
-        matrix = glm::scale(matrix, glm::vec3(i.radius()));
-        glUniformMatrix4fv(shaderTexture_modelMatrix, 1, GL_FALSE, glm::value_ptr(matrix));
+    /* Pick how detailed each planet needs to be, and group them by it. */
+    planetInstances.update(universe, camera);
+
+    if (instancing) {
+        /* Upload every planet's position and radius, and draw each level all at once. */
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, planetInstances.size() * sizeof(glm::vec4), planetInstances.instances.data(), GL_STREAM_DRAW);
+
+        glEnableVertexAttribArray(instance);
+        glVertexAttribDivisor(instance, 1);
+
+        glUniformMatrix4fv(shaderTexture_modelMatrix, 1, GL_FALSE, glm::value_ptr(glm::mat4()));
+
+        /* Impostors take care of everything but the points. */
+        for (int level = drawImpostors ? SphereLevels::pointLevel : 0; level < PlanetInstances::levels; ++level) {
+            if (planetInstances.levelSize(level) == 0)
+                continue;
+
+            /* Start the instances at the level's first planet. */
+            glVertexAttribPointer(instance, 4, GL_FLOAT, GL_FALSE, 0, (void*)(planetInstances.levelStart[level] * sizeof(glm::vec4)));
 
-        /* Render all the triangles... */
-        glDrawElements(GL_TRIANGLES, highResTriCount, GL_UNSIGNED_INT, 0);
+            glDrawElementsInstanced(level == SphereLevels::pointLevel ? GL_POINTS : GL_TRIANGLES,
+                                    planetIndexStart[level + 1] - planetIndexStart[level], GL_UNSIGNED_INT,
+                                    (void*)(planetIndexStart[level] * sizeof(uint32_t)), GLsizei(planetInstances.levelSize(level)));
+        }
+
+        if (drawImpostors && planetInstances.levelStart[SphereLevels::pointLevel] > 0) {
+            glDisableVertexAttribArray(normal);
+            glDisableVertexAttribArray(tangent);
+            glDisableVertexAttribArray(uv);
+
+            glUseProgram(shaderImpostor);
+            glUniformMatrix4fv(shaderImpostor_cameraMatrix, 1, GL_FALSE, glm::value_ptr(camera.camera));
+            glUniformMatrix4fv(shaderImpostor_viewMatrix, 1, GL_FALSE, glm::value_ptr(camera.view));
+            glUniform3fv(shaderImpostor_lightDir, 1, glm::value_ptr(light));
+            glUniform3fv(shaderImpostor_eye, 1, glm::value_ptr(camera.getEye()));
+            glUniform3fv(shaderImpostor_up, 1, glm::value_ptr(camera.getUp()));
+
+            glVertexAttribPointer(instance, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+            glBindBuffer(GL_ARRAY_BUFFER, impostorVBO);
+            glVertexAttribPointer(vertex, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, ImpostorQuad::vertexCount, GLsizei(planetInstances.levelStart[SphereLevels::pointLevel]));
+        }
+
+        glVertexAttribDivisor(instance, 0);
+        glDisableVertexAttribArray(instance);
+    } else {
+        for (int level = 0; level < PlanetInstances::levels; ++level) {
+            for (size_t i = planetInstances.levelStart[level]; i < planetInstances.levelStart[level + 1]; ++i) {
+                const glm::vec4& planet = planetInstances.instances[i];
+
+                /* Create a matrix translated by the position and scaled by the radius. */
+                glm::mat4 matrix = glm::translate(glm::vec3(planet));
+                matrix = glm::scale(matrix, glm::vec3(planet.w));
+                glUniformMatrix4fv(shaderTexture_modelMatrix, 1, GL_FALSE, glm::value_ptr(matrix));
+
+                /* Render all the triangles... */
+                glDrawElements(level == SphereLevels::pointLevel ? GL_POINTS : GL_TRIANGLES,
+                               planetIndexStart[level + 1] - planetIndexStart[level], GL_UNSIGNED_INT,
+                               (void*)(planetIndexStart[level] * sizeof(uint32_t)));
+            }
+        }
     }
 
     /* Now the texture shader and uv's don't get used until next frame. */
@@ -485,10 +616,18 @@ void PlanetsWindow::paint() {
         /* There is no model matrix for drawing trails, they're in world space, just use identity. */
         glUniformMatrix4fv(shaderColor_modelMatrix, 1, GL_FALSE, glm::value_ptr(glm::mat4()));
 
-        for (const auto& i : universe) {
-            glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, 0, i.path.data());
-            glDrawArrays(GL_LINE_STRIP, 0, GLsizei(i.path.size()));
-        }
+        glBindBuffer(GL_ARRAY_BUFFER, trailVBO);
+
+        if (trailBuffer.update(universe))
+            glBufferData(GL_ARRAY_BUFFER, trailBuffer.size() * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
+
+        for (const TrailBuffer::Upload& upload : trailBuffer.uploads)
+            glBufferSubData(GL_ARRAY_BUFFER, upload.offset * sizeof(glm::vec3), upload.count * sizeof(glm::vec3), upload.data);
+
+        glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glMultiDrawArrays(GL_LINE_STRIP, trailBuffer.firsts.data(), trailBuffer.counts.data(), GLsizei(trailBuffer.firsts.size()));
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
     if (placing.step == PlacingInterface::FreeVelocity) {
@@ -663,6 +802,14 @@ void PlanetsWindow::paintUI(const float delay) {
             if (ImGui::MenuItem("New", "Ctrl+N"))
                 newUniverse();
 
+            if (ImGui::MenuItem("Save", "Ctrl+S", false, !universe.isEmpty()))
+                saveUniverse();
+
+            ImGui::MenuItem("Autosave", "", &autosave);
+
+            if (ImGui::MenuItem("Record", "Ctrl+R", recorder != nullptr, !player))
+                toggleRecording();
+
             if (ImGui::MenuItem("Quit", "Escape"))
                 onClose();
 
@@ -677,6 +824,7 @@ void PlanetsWindow::paintUI(const float delay) {
             ImGui::MenuItem("Show Grid", "Ctrl+G", &grid.draw);
             ImGui::MenuItem("Show Trails", "Ctrl+T", &drawTrails);
             ImGui::MenuItem("Show Planar Circles", "Ctrl+Y", &drawPlanarCircles);
+            ImGui::MenuItem("Sphere Impostors", "", &drawImpostors, instancing);
 
             ImGui::Separator();
 
@@ -732,7 +880,7 @@ void PlanetsWindow::paintUI(const float delay) {
 
     if (showSpeedWindow) {
         ImGui::SetNextWindowPos(ImVec2(10, 200), ImGuiSetCond_FirstUseEver);
-        ImGui::Begin("Speed Controls", &showSpeedWindow, ImVec2(360, 100));
+        ImGui::Begin("Speed Controls", &showSpeedWindow, ImVec2(360, 240));
 
         ImGui::SliderFloat("Speed", &universe.simspeed, 0.0f, 64.0f, "%.3fx");
 
@@ -759,12 +907,38 @@ void PlanetsWindow::paintUI(const float delay) {
                 universe.simspeed *= 2.0f;
         }
 
+        ImGui::Combo("Integrator", (int*)&universe.integrator, "Semi-implicit Euler\0Leapfrog\0Yoshida 4th Order\0");
+        ImGui::Combo("Gravity", (int*)&universe.forceBackend, "Direct Sum\0Barnes-Hut\0Fast Multipole\0");
+
+        if (universe.forceBackend == PlanetsUniverse::BarnesHut)
+            ImGui::SliderFloat("Opening Angle", &universe.barnesHutTheta, 0.0f, 1.5f);
+
+        if (universe.forceBackend == PlanetsUniverse::FastMultipole) {
+            ImGui::SliderFloat("Opening Angle", &universe.multipoleTheta, 0.0f, 1.0f);
+            ImGui::SliderInt("Expansion Order", &universe.multipoleOrder, 1, MultipoleTree::maxOrder);
+        }
+
+        ImGui::SliderInt("Threads", (int*)&universe.threadCount, 1, ThreadPool::hardwareThreads());
+        /* Reseed as well, so the planets generated from here on repeat along with the simulation. */
+        if (ImGui::Checkbox("Deterministic", &universe.deterministic) && universe.deterministic)
+            universe.randSeed(unsigned(deterministicSeed));
+        if (universe.deterministic && ImGui::InputInt("Seed", &deterministicSeed))
+            universe.randSeed(unsigned(deterministicSeed));
+
+        ImGui::SliderInt("Timestep Levels", &universe.timestepLevels, 0, 10);
+        if (universe.timestepLevels > 0)
+            ImGui::SliderFloat("Timestep Accuracy", &universe.timestepAccuracy, 0.005f, 0.2f, "%.3f", 2.0f);
+
+        ImGui::Checkbox("Fixed Timestep", &universe.fixedTimestep);
+        if (universe.fixedTimestep)
+            ImGui::SliderFloat("Step Length", &universe.fixedStep, 10.0f, 100000.0f, "%.0f", 3.0f);
+
         ImGui::End();
     }
 
     if (showViewSettingsWindow) {
         ImGui::SetNextWindowPos(ImVec2(10, 310), ImGuiSetCond_FirstUseEver);
-        ImGui::Begin("View Settings", &showViewSettingsWindow, ImVec2(360, 120));
+        ImGui::Begin("View Settings", &showViewSettingsWindow, ImVec2(360, 190));
 
         ImGui::SliderInt("Path Length", (int*)&universe.pathLength, 100, 4000);
 
@@ -773,6 +947,11 @@ void PlanetsWindow::paintUI(const float delay) {
         if (ImGui::SliderFloat("Path Record Distance", &distance, 0.2f, 10.0f))
             universe.pathRecordDistance = distance * distance;
 
+        ImGui::Combo("Path Recording", (int*)&universe.pathRecording, "Every Step\0Every Frame\0Every Interval\0");
+        if (universe.pathRecording == PlanetsUniverse::EveryInterval)
+            ImGui::SliderFloat("Path Record Interval", &universe.pathRecordInterval, 1.0f, 1000.0f, "%.0f", 2.0f);
+        ImGui::SliderAngle("Path Record Angle", &universe.pathRecordAngle, 0.0f, 45.0f);
+
         ImGui::SliderInt("Steps Per Frame", &universe.stepsPerFrame, 1, 4000);
         ImGui::SliderInt("Grid Size", (int*)&grid.range, 4, 64);
 
@@ -784,15 +963,20 @@ void PlanetsWindow::paintUI(const float delay) {
         ImGui::Begin("Information", &showInfoWindow, ImVec2(360, 320));
 
         if (universe.isSelectedValid() && ImGui::CollapsingHeader("Selected Planet")) {
-            Planet& p = universe.getSelected();
+            PlanetRef p = universe.getSelected();
             ImGui::Text("Position: x: %f, y: %f, z: %f", p.position.x, p.position.y, p.position.z);
             ImGui::Text("Velocity: x: %f, y: %f, z: %f", p.velocity.x / universe.velocityfac, p.velocity.y / universe.velocityfac, p.velocity.z / universe.velocityfac);
             ImGui::Text("Mass:     %f", p.mass());
             ImGui::Text("Radius:   %f", p.radius());
         }
 
-        if (ImGui::CollapsingHeader("General Info", ImGuiTreeNodeFlags_DefaultOpen))
+        if (ImGui::CollapsingHeader("General Info", ImGuiTreeNodeFlags_DefaultOpen)) {
             ImGui::Text("Planet Count: %zu", universe.size());
+            if (!lastSave.empty())
+                ImGui::TextWrapped("Last Save: %s", lastSave.c_str());
+            if (recorder)
+                ImGui::TextWrapped("Recording: %s (%zu frame(s), %.1f MB)", recordingName.c_str(), recorder->frames(), recorder->bytes() * 1.0e-6);
+        }
 
         if (ImGui::CollapsingHeader("Statistics")) {
             ImGui::PlotLines("Frame Time\n(in ms)", frameTimes.data(), static_cast<int>(frameTimes.size()),
@@ -828,6 +1012,32 @@ void PlanetsWindow::paintUI(const float delay) {
         ImGui::End();
     }
 
+    if (player) {
+        ImGui::SetNextWindowPos(ImVec2(380, 30), ImGuiSetCond_FirstUseEver);
+        ImGui::Begin("Playback", nullptr, ImVec2(420, 100));
+
+        int frame = int(player->currentFrame());
+        if (ImGui::SliderInt("Frame", &frame, 0, int(player->frames()) - 1) && showFrame(size_t(frame)))
+            playbackTime = player->frameTime(size_t(frame));
+
+        /* Showing a frame closes the recording if it can't be read. */
+        if (player) {
+            ImGui::Text("Time: %.2fs of %.2fs", player->frameTime(player->currentFrame()), player->frameTime(player->frames() - 1));
+
+            if (ImGui::Button(playing ? "Pause" : "Play")) {
+                /* Playing from the end starts again. */
+                if (!playing && player->currentFrame() + 1 == player->frames() && showFrame(0))
+                    playbackTime = player->frameTime(0);
+                playing = !playing;
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Stop"))
+                closeRecording();
+        }
+
+        ImGui::End();
+    }
+
 #ifndef NDEBUG
     if (showTestWindow) {
         ImGui::SetNextWindowPos(ImVec2(650, 20), ImGuiSetCond_FirstUseEver);
@@ -1014,6 +1224,14 @@ void PlanetsWindow::doKeyPress(const SDL_Keysym& key) {
         if (key.mod & KMOD_CTRL)
             newUniverse();
         break;
+    case SDLK_s:
+        if ((key.mod & KMOD_CTRL) && !universe.isEmpty())
+            saveUniverse();
+        break;
+    case SDLK_r:
+        if ((key.mod & KMOD_CTRL) && !player)
+            toggleRecording();
+        break;
     case SDLK_t:
         if (key.mod & KMOD_CTRL)
             drawTrails = !drawTrails;
@@ -1057,6 +1275,98 @@ void PlanetsWindow::newUniverse() {
         universe.deleteAll();
 }
 
+void PlanetsWindow::saveUniverse() {
+    saver.save(universe, timestampedName(saveFolder, PlanetsUniverse::binaryExtension));
+}
+
+void PlanetsWindow::updateSaves() {
+    if (autosave)
+        saver.autosave(universe);
+
+    for (const BackgroundSaver::Result& result : saver.results()) {
+        if (result.error.empty()) {
+            lastSave = result.filename;
+        } else {
+            lastSave = result.error;
+            SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_WARNING, "Error Saving Simulation", result.error.c_str(), windowSDL);
+        }
+    }
+}
+
+void PlanetsWindow::toggleRecording() {
+    if (recorder) {
+        recorder.reset();
+        return;
+    }
+
+    try {
+        recordingName = timestampedName(saveFolder, RecordingPlayer::extension);
+        recorder.reset(new Recorder(recordingName));
+    } catch (const std::exception& error) {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_WARNING, "Error Recording Simulation", error.what(), windowSDL);
+    }
+}
+
+bool PlanetsWindow::openRecording(const char* filename) {
+    std::unique_ptr<RecordingPlayer> opened;
+
+    /* Make sure it can be read before stopping anything. */
+    try {
+        opened.reset(new RecordingPlayer(filename));
+        if (opened->frames() == 0)
+            return false;
+        opened->seek(0);
+    } catch (...) {
+        return false;
+    }
+
+    player.swap(opened);
+    recorder.reset();
+    simulation.stop();
+    universe.deleteAll();
+
+    player->show(universe);
+    playing = true;
+    playbackTime = player->frameTime(0);
+
+    return true;
+}
+
+void PlanetsWindow::closeRecording() {
+    player.reset();
+    universe.deleteAll();
+    simulation.start(universe);
+}
+
+void PlanetsWindow::updatePlayback(const float delay) {
+    if (!playing)
+        return;
+
+    playbackTime += double(delay) * universe.simspeed;
+
+    size_t frame = player->currentFrame();
+    while (frame + 1 < player->frames() && player->frameTime(frame + 1) <= playbackTime)
+        ++frame;
+
+    if (showFrame(frame) && frame + 1 == player->frames())
+        playing = false;
+}
+
+bool PlanetsWindow::showFrame(size_t frame) {
+    if (frame == player->currentFrame())
+        return true;
+
+    try {
+        player->seek(frame);
+        player->show(universe);
+        return true;
+    } catch (const std::exception& error) {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_WARNING, "Error Playing Recording", error.what(), windowSDL);
+        closeRecording();
+        return false;
+    }
+}
+
 void PlanetsWindow::onResized(uint32_t width, uint32_t height) {
     /* Store the width and height for later use. */
     windowSize = glm::ivec2(width, height);
@@ -54,6 +54,7 @@ GLuint linkShaderProgram(GLuint vsh, GLuint fsh) {
     glBindAttribLocation(program, normal,   "normal");
     glBindAttribLocation(program, tangent,  "tangent");
     glBindAttribLocation(program, uv,       "uv");
+    glBindAttribLocation(program, instance, "instance");
 
     glLinkProgram(program);
 